@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2014-2020 by Farsight Security, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "defs.h"
+#include "pdns.h"
+#include "hash.h"
+#include "aggregate.h"
+#include "sink.h"
+#include "globals.h"
+
+/* what each group of an --aggregate run is keyed on. */
+typedef enum { agg_rrtype, agg_depth, agg_zone } agg_key_e;
+
+static int group_cmp(const void *, const void *);
+
+static agg_key_e agg_key = agg_rrtype;
+static int agg_zone_depth = AGGREGATE_ZONE_DEPTH;
+static hash_t agg_groups = NULL;
+
+/* aggregate_parse -- ingest the argument to --aggregate.
+ *
+ * accepts "rrtype", "depth", "zone", or "zone:N".
+ * returns NULL if ok, else a static error message.
+ */
+const char *
+aggregate_parse(const char *arg) {
+	if (strcmp(arg, "rrtype") == 0) {
+		agg_key = agg_rrtype;
+	} else if (strcmp(arg, "depth") == 0) {
+		agg_key = agg_depth;
+	} else if (strcmp(arg, "zone") == 0) {
+		agg_key = agg_zone;
+	} else if (strncmp(arg, "zone:", 5) == 0) {
+		char *ep;
+		long depth = strtol(arg + 5, &ep, 10);
+
+		if (ep == arg + 5 || *ep != '\0' || depth < 1 || depth > 127)
+			return "--aggregate zone:N needs N from 1 to 127";
+		agg_key = agg_zone;
+		agg_zone_depth = (int)depth;
+	} else {
+		return "--aggregate must be 'rrtype', 'depth', or 'zone[:N]'";
+	}
+	return NULL;
+}
+
+/* present_aggregate -- count one tuple into its group; emit nothing.
+ */
+void
+present_aggregate(pdns_tuple_ct tup,
+		  const char *jsonbuf __attribute__ ((unused)),
+		  size_t jsonlen __attribute__ ((unused)),
+		  sink_t sink __attribute__ ((unused)))
+{
+	const char *name = or_else(tup->rrname, tup->rdata);
+	const char *key = NULL;
+	char depth_str[sizeof "-2147483648"];
+
+	switch (agg_key) {
+	case agg_rrtype:
+		key = tup->rrtype;
+		break;
+	case agg_depth:
+		if (name != NULL) {
+			snprintf(depth_str, sizeof depth_str, "%d",
+				 name_depth(name));
+			key = depth_str;
+		}
+		break;
+	case agg_zone:
+		if (name != NULL)
+			key = name_suffix(name, agg_zone_depth);
+		break;
+	}
+	if (key == NULL)
+		key = "";
+
+	if (agg_groups == NULL)
+		agg_groups = hash_new();
+	hash_put(agg_groups, key, strlen(key), NULL)->val.num++;
+}
+
+/* aggregate_fini -- emit one JSON line per group, busiest first.
+ */
+void
+aggregate_fini(sink_t sink) {
+	const char *field = NULL;
+	hashent_t *vec, ent;
+	size_t n, i;
+
+	if (agg_groups == NULL)
+		return;
+	switch (agg_key) {
+	case agg_rrtype:
+		field = "rrtype";
+		break;
+	case agg_depth:
+		field = "depth";
+		break;
+	case agg_zone:
+		field = "zone";
+		break;
+	}
+
+	vec = calloc(agg_groups->count, sizeof *vec);
+	if (vec == NULL)
+		my_panic(true, "calloc");
+	n = 0;
+	for (ent = hash_next(agg_groups, NULL);
+	     ent != NULL;
+	     ent = hash_next(agg_groups, ent))
+		vec[n++] = ent;
+	qsort(vec, n, sizeof *vec, group_cmp);
+
+	for (i = 0; i < n; i++) {
+		json_t *obj = json_object();
+
+		if (agg_key == agg_depth)
+			json_object_set_new(obj, field,
+					    json_integer(atoi(vec[i]->key)));
+		else
+			json_object_set_new(obj, field,
+					    json_string(vec[i]->key));
+		json_object_set_new(obj, "count",
+				    json_integer(vec[i]->val.num));
+		json_dumpf(obj, sink->out, JSON_INDENT(0) | JSON_COMPACT);
+		putc('\n', sink->out);
+		json_decref(obj);
+	}
+	DESTROY(vec);
+	hash_destroy(agg_groups, NULL);
+	agg_groups = NULL;
+}
+
+/* name_depth -- count the labels in a presentation-format DNS name.
+ */
+int
+name_depth(const char *name) {
+	int depth = 0;
+	bool in_label = false;
+	const char *p;
+
+	for (p = name; *p != '\0'; p++) {
+		if (*p == '.') {
+			in_label = false;
+			continue;
+		}
+		if (!in_label) {
+			depth++;
+			in_label = true;
+		}
+		if (*p == '\\' && p[1] != '\0')
+			p++;
+	}
+	return depth;
+}
+
+/* name_suffix -- return the tail of a name holding its last "depth" labels.
+ *
+ * the result points into the name, which is returned whole if it is
+ * already that shallow.
+ */
+const char *
+name_suffix(const char *name, int depth) {
+	int skip = name_depth(name) - depth;
+	const char *p = name;
+
+	while (skip > 0 && *p != '\0') {
+		if (*p == '\\' && p[1] != '\0') {
+			p += 2;
+			continue;
+		}
+		if (*p++ == '.')
+			skip--;
+	}
+	return p;
+}
+
+/* group_cmp -- qsort comparator, highest count first, then by key.
+ */
+static int
+group_cmp(const void *a, const void *b) {
+	const struct hashent *x = *(const hashent_t *)a,
+		*y = *(const hashent_t *)b;
+
+	if (x->val.num != y->val.num)
+		return (x->val.num > y->val.num) ? -1 : 1;
+	return strcmp(x->key, y->key);
+}
@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2014-2020 by Farsight Security, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGGREGATE_H_INCLUDED
+#define AGGREGATE_H_INCLUDED 1
+
+#include "pdns.h"
+
+/* default number of labels kept by "--aggregate zone" */
+#define AGGREGATE_ZONE_DEPTH 2
+
+const char *aggregate_parse(const char *);
+void present_aggregate(pdns_tuple_ct, const char *, size_t, sink_t);
+void aggregate_fini(sink_t);
+int name_depth(const char *);
+const char *name_suffix(const char *, int);
+
+#endif /*AGGREGATE_H_INCLUDED*/
@@ -0,0 +1,219 @@
+/*
+ * Copyright (c) 2014-2020 by Farsight Security, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdbool.h>
+
+#include "defs.h"
+#include "netio.h"
+#include "pdns.h"
+#include "aimd.h"
+#include "globals.h"
+
+static void aimd_set(double, const char *);
+
+/* the window, and what it has been. */
+static double window = AIMD_INITIAL;
+static size_t window_min = AIMD_INITIAL, window_max = AIMD_INITIAL;
+static size_t ceiling = AIMD_MAX;
+static unsigned long ngrown = 0, ncut = 0;
+/* fetches in progress, and the most there have been at once. */
+static size_t running = 0, running_max = 0;
+/* when the window was last cut; fetches started before then were
+ * launched under the old window and cannot call for another cut.
+ */
+static long last_cut_ms = -1L;
+/* the current epoch, and the rate seen in the last. */
+static long epoch_ms = 0L, epoch_rows = 0L;
+static bool epoch_full = false;
+static double last_rate = 0.0;
+static int flat_epochs = 0;
+/* what the fetches have seen; the average is moving, over about the
+ * last eight.
+ */
+static long ttfb_least = -1L, ttfb_sum = 0L, ttfb_n = 0L;
+static double ttfb_avg = 0.0;
+static long rows_total = 0L;
+static unsigned long nfetches = 0, npushback = 0, nslow = 0;
+
+/* aimd_active -- true if the run is one the window drives.
+ */
+bool
+aimd_active(void) {
+	return batch_run || exhaustive || nshards != 0 || fanout;
+}
+
+/* aimd_jobs -- how many fetches may be running now.
+ */
+size_t
+aimd_jobs(void) {
+	return (size_t)window;
+}
+
+/* aimd_limit -- hold the window to at most this many, e.g. for what the
+ * server allows at once.
+ */
+void
+aimd_limit(size_t most) {
+	ceiling = (most < AIMD_MIN) ? AIMD_MIN
+		: (most > AIMD_MAX) ? AIMD_MAX : most;
+	if (window > (double)ceiling)
+		aimd_set((double)ceiling, "server limit");
+}
+
+/* aimd_start -- a fetch has started.
+ */
+void
+aimd_start(void) {
+	running++;
+	if (running > running_max)
+		running_max = running;
+	if (running >= aimd_jobs())
+		epoch_full = true;
+}
+
+/* aimd_end -- a fetch has been reaped.
+ */
+void
+aimd_end(void) {
+	running--;
+}
+
+/* aimd_rows -- count rows as the fetches receive them, so that long
+ * streams show in the rate of the epoch they arrive in.
+ */
+void
+aimd_rows(long rows) {
+	rows_total += rows;
+	epoch_rows += rows;
+}
+
+/* aimd_tick -- once an epoch, grow if the rate rose with the window in
+ * use.  called as often as io runs.
+ */
+void
+aimd_tick(void) {
+	long now = elapsed_ms(&startup_time);
+	double rate;
+
+	if (now - epoch_ms < AIMD_EPOCH_MS)
+		return;
+	rate = (double)epoch_rows * 1000.0 / (double)(now - epoch_ms);
+	/* a window not filled would not fill a larger one. */
+	if (epoch_full && rate * 100.0 > last_rate * (100.0 + AIMD_GAIN_PCT)) {
+		aimd_set(window + 1.0, "rate rising");
+		flat_epochs = 0;
+	} else if (epoch_full && ++flat_epochs >= AIMD_PROBE_EPOCHS) {
+		aimd_set(window + 1.0, "probing");
+		flat_epochs = 0;
+	}
+	DEBUG(1, true, "aimd: %.0f rows/s, window %zu, %zu running\n",
+	      rate, aimd_jobs(), running);
+	last_rate = rate;
+	epoch_ms = now;
+	epoch_rows = 0L;
+	epoch_full = (running >= aimd_jobs());
+}
+
+/* aimd_result -- learn from a fetch which ended: its HTTP status, how
+ * long it took to start answering (-1 if it never did), and how long ago
+ * it started.
+ */
+void
+aimd_result(long rcode, long ttfb, long age) {
+	long now = elapsed_ms(&startup_time);
+	/* one cut per window's worth of fetches. */
+	bool cuttable = (now - age > last_cut_ms);
+
+	nfetches++;
+
+	/* the server pushing back is answered at once. */
+	if (rcode == HTTP_TOO_MANY_REQUESTS ||
+	    rcode == HTTP_SERVICE_UNAVAILABLE)
+	{
+		npushback++;
+		if (cuttable)
+			aimd_set(window / 2.0, "pushback");
+		return;
+	}
+	if (ttfb >= 0L) {
+		ttfb_avg = (ttfb_n == 0L) ? (double)ttfb
+			: ttfb_avg + ((double)ttfb - ttfb_avg) / 8.0;
+		ttfb_sum += ttfb;
+		ttfb_n++;
+		if (ttfb_least < 0L || ttfb < ttfb_least)
+			ttfb_least = ttfb;
+		if (ttfb_avg > (double)(ttfb_least * AIMD_TTFB_FACTOR) &&
+		    ttfb_avg > (double)(ttfb_least + AIMD_TTFB_SLACK_MS))
+		{
+			nslow++;
+			if (cuttable)
+				aimd_set(window * 0.75, "slow first byte");
+			return;
+		}
+	}
+
+	aimd_tick();
+}
+
+/* aimd_report -- for --timings, say how the fetches went and what the
+ * window did.
+ */
+void
+aimd_report(void) {
+	long ms = elapsed_ms(&startup_time);
+
+	if (!timings)
+		return;
+	my_logf("--timings: %lu fetch(es), %ld row(s) in %ld.%03ld s,"
+		" %.0f rows/s", nfetches, rows_total, ms / 1000L, ms % 1000L,
+		(ms > 0L) ? (double)rows_total * 1000.0 / (double)ms : 0.0);
+	if (ttfb_n > 0L)
+		my_logf("--timings: first byte after %ld ms at least,"
+			" %ld ms on average", ttfb_least, ttfb_sum / ttfb_n);
+	my_logf("--timings: window %zu (from %zu to %zu), %zu running at"
+		" most; grown %lu time(s), cut %lu time(s) for %lu pushback(s)"
+		" and %lu slow first byte(s)",
+		aimd_jobs(), window_min, window_max, running_max,
+		ngrown, ncut, npushback, nslow);
+}
+
+/* aimd_set -- move the window, within bounds.
+ */
+static void
+aimd_set(double next, const char *why) {
+	size_t before = aimd_jobs();
+
+	if (next < AIMD_MIN)
+		next = AIMD_MIN;
+	if (next > (double)ceiling)
+		next = (double)ceiling;
+	if (next < window) {
+		ncut++;
+		last_cut_ms = elapsed_ms(&startup_time);
+		epoch_full = false;
+		flat_epochs = 0;
+	} else if (next > window) {
+		ngrown++;
+	}
+	window = next;
+	if (aimd_jobs() < window_min)
+		window_min = aimd_jobs();
+	if (aimd_jobs() > window_max)
+		window_max = aimd_jobs();
+	if (aimd_jobs() != before)
+		DEBUG(1, true, "aimd: window %zu -> %zu (%s)\n",
+		      before, aimd_jobs(), why);
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2014-2020 by Farsight Security, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AIMD_H_INCLUDED
+#define AIMD_H_INCLUDED 1
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* --batch, --exhaustive, --shard and --fanout-rrtypes run as many
+ * fetches at once as an additive increase, multiplicative decrease
+ * controller allows: starting from AIMD_INITIAL, one more each
+ * AIMD_EPOCH_MS in which the rows per second rose by AIMD_GAIN_PCT
+ * percent with the window full (or, to probe, after
+ * AIMD_PROBE_EPOCHS of no change), half as many on an HTTP 429 or 503,
+ * and a quarter fewer when the average time to first byte grows
+ * AIMD_TTFB_FACTOR times over the least seen.
+ */
+#define AIMD_INITIAL 8
+#define AIMD_MIN 1
+#define AIMD_MAX 64
+#define AIMD_EPOCH_MS 1000L
+#define AIMD_GAIN_PCT 5
+#define AIMD_PROBE_EPOCHS 5
+#define AIMD_TTFB_FACTOR 4
+/* and at least this much slower, so fast fetches' jitter is not taken
+ * for pushback.
+ */
+#define AIMD_TTFB_SLACK_MS 250L
+/* a fetch pushed back before any result is tried again, up to this many
+ * times, after the server's Retry-After or else this long, doubling.
+ */
+#define AIMD_RETRIES 3
+#define AIMD_RETRY_MS 1000L
+
+bool aimd_active(void);
+size_t aimd_jobs(void);
+void aimd_limit(size_t);
+void aimd_start(void);
+void aimd_end(void);
+void aimd_rows(long);
+void aimd_tick(void);
+void aimd_result(long, long, long);
+void aimd_report(void);
+
+#endif /*AIMD_H_INCLUDED*/
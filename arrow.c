@@ -0,0 +1,745 @@
+/*
+ * Copyright (c) 2014-2020 by Farsight Security, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* write results as an Apache Arrow IPC stream (columnar format version 5).
+ *
+ * the stream is a schema message, then for each batch of rows a
+ * dictionary batch carrying any rrtypes not seen before (as a delta after
+ * the first) and a record batch, then an end-of-stream marker.  the
+ * flatbuffer metadata is built here by hand rather than with the
+ * flatbuffers library: every table is laid out before its children, so
+ * all offsets point forward as the format requires.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "defs.h"
+#include "pdns.h"
+#include "hash.h"
+#include "budget.h"
+#include "arrow.h"
+#include "sink.h"
+#include "globals.h"
+
+/* Message.version: MetadataVersion.V5 */
+#define ARROW_METADATA_V5 4
+/* MessageHeader union tags */
+#define ARROW_HDR_SCHEMA 1
+#define ARROW_HDR_DICTIONARY 2
+#define ARROW_HDR_RECORDBATCH 3
+/* Type union tags */
+#define ARROW_TYPE_INT 2
+#define ARROW_TYPE_UTF8 5
+#define ARROW_TYPE_TIMESTAMP 10
+/* the one dictionary in the stream, for rrtype */
+#define ARROW_RRTYPE_DICT 0
+
+/* more than any table here has. */
+#define FB_MAX_FIELDS 8
+/* three buffers for each of the seven columns. */
+#define ARROW_MAX_BUFFERS 21
+
+typedef enum { col_utf8, col_dict, col_int64, col_timestamp } coltype_e;
+
+static const struct colspec {
+	const char	*name;
+	coltype_e	 type;
+} colspecs[] = {
+	{ "rrname", col_utf8 },
+	{ "rrtype", col_dict },
+	{ "rdata", col_utf8 },
+	{ "raw_rdata", col_utf8 },
+	{ "count", col_int64 },
+	{ "time_first", col_timestamp },
+	{ "time_last", col_timestamp },
+};
+#define NCOLS (sizeof colspecs / sizeof colspecs[0])
+
+/* one column of the batch being accumulated. */
+struct column {
+	uint8_t		*valid;
+	size_t		 nulls;
+	int32_t		*offsets;	/* col_utf8 */
+	char		*data;
+	size_t		 datalen, datasize;
+	int32_t		*indices;	/* col_dict */
+	int64_t		*values;	/* col_int64, col_timestamp */
+};
+
+/* a growing output buffer, for flatbuffer metadata or a message body. */
+struct obuf {
+	uint8_t		*buf;
+	size_t		 len, size;
+};
+
+/* one scalar or offset field of a flatbuffer table. */
+struct fbfield {
+	uint16_t	 id;
+	uint8_t		 size;
+	uint64_t	 value;
+	size_t		 pos;		/* set by fb_table */
+};
+
+/* a message body and the (offset, length) of each buffer in it. */
+struct body {
+	struct obuf	 ob;
+	uint64_t	 desc[ARROW_MAX_BUFFERS * 2];
+	size_t		 nbufs;
+};
+
+static void arrow_init(FILE *);
+static void batch_flush(void);
+static void column_str(struct column *, size_t, const char *);
+static void column_int(struct column *, size_t, const json_t *, int64_t);
+static void emit_schema(void);
+static void emit_dictionary(void);
+static void emit_message(struct obuf *, uint8_t, struct body *,
+			 size_t (*)(struct obuf *, struct body *));
+static size_t fb_schema(struct obuf *, struct body *);
+static size_t fb_field(struct obuf *, const struct colspec *);
+static size_t fb_int_type(struct obuf *, int32_t);
+static size_t fb_dictionary(struct obuf *, struct body *);
+static size_t fb_record_batch(struct obuf *, struct body *);
+static size_t fb_table(struct obuf *, struct fbfield *, size_t);
+static size_t fb_vector(struct obuf *, const uint64_t *, size_t);
+static size_t fb_offsets(struct obuf *, size_t);
+static size_t fb_string(struct obuf *, const char *);
+static void fb_patch(struct obuf *, size_t, size_t);
+static void body_add(struct body *, const void *, size_t);
+static void ob_pad(struct obuf *, size_t, size_t);
+static size_t ob_put(struct obuf *, const void *, size_t);
+static void ob_free(struct obuf *);
+static void ob_le(struct obuf *, size_t, uint64_t, size_t);
+
+static struct column columns[NCOLS];
+static size_t nrows = 0;
+static bool started = false;
+static hash_t rrtypes = NULL;
+static char **dict_values = NULL;
+static size_t ndict = 0, maxdict = 0, dict_sent = 0;
+static struct obuf meta;
+static FILE *arrow_out = NULL;
+static struct body body;
+static size_t charged = 0;	/* column buffers drawn on --max-memory */
+
+/* present_arrow -- add one tuple to the current batch, writing the batch
+ * out when it is full.
+ */
+void
+present_arrow(pdns_tuple_ct tup,
+	      const char *jsonbuf __attribute__ ((unused)),
+	      size_t jsonlen __attribute__ ((unused)),
+	      sink_t sink)
+{
+	if (!started)
+		arrow_init(sink->out);
+
+	column_str(&columns[0], nrows, tup->rrname);
+	if (tup->rrtype != NULL) {
+		bool created;
+		hashent_t ent = hash_put(rrtypes, tup->rrtype,
+					 strlen(tup->rrtype), &created);
+
+		if (created) {
+			if (ndict == maxdict) {
+				maxdict = (maxdict == 0) ? 64 : maxdict * 2;
+				dict_values = realloc(dict_values,
+					maxdict * sizeof *dict_values);
+				if (dict_values == NULL)
+					my_panic(true, "realloc");
+			}
+			dict_values[ndict] = strdup(tup->rrtype);
+			ent->val.num = (long)ndict++;
+		}
+		columns[1].indices[nrows] = (int32_t)ent->val.num;
+		columns[1].valid[nrows / 8] |= (uint8_t)(1 << (nrows % 8));
+	} else {
+		columns[1].nulls++;
+		columns[1].indices[nrows] = 0;
+	}
+	column_str(&columns[2], nrows, tup->rdata);
+	column_str(&columns[3], nrows, tup->raw_rdata);
+	column_int(&columns[4], nrows, tup->obj.count, tup->count);
+	column_int(&columns[5], nrows, tup->obj.time_first,
+		   (int64_t)tup->time_first);
+	column_int(&columns[6], nrows, tup->obj.time_last,
+		   (int64_t)tup->time_last);
+
+	if (++nrows == ARROW_BATCH_ROWS)
+		batch_flush();
+}
+
+/* arrow_fini -- write the last batch and end the stream.
+ */
+void
+arrow_fini(sink_t sink) {
+	static const uint8_t eos[8] = { 0xff, 0xff, 0xff, 0xff, 0, 0, 0, 0 };
+	size_t i;
+
+	if (!started)
+		arrow_init(sink->out);
+	if (nrows > 0)
+		batch_flush();
+	fwrite(eos, 1, sizeof eos, arrow_out);
+
+	for (i = 0; i < NCOLS; i++) {
+		DESTROY(columns[i].valid);
+		DESTROY(columns[i].offsets);
+		DESTROY(columns[i].data);
+		DESTROY(columns[i].indices);
+		DESTROY(columns[i].values);
+	}
+	for (i = 0; i < ndict; i++)
+		DESTROY(dict_values[i]);
+	DESTROY(dict_values);
+	hash_destroy(rrtypes, NULL);
+	ob_free(&meta);
+	ob_free(&body.ob);
+	budget_give(charged);
+	charged = 0;
+}
+
+/* arrow_init -- allocate the batch columns and write the schema.
+ */
+static void
+arrow_init(FILE *out) {
+	size_t i;
+
+	arrow_out = out;
+
+	for (i = 0; i < NCOLS; i++) {
+		struct column *col = &columns[i];
+		size_t need = ARROW_BATCH_ROWS / 8;
+
+		switch (colspecs[i].type) {
+		case col_utf8:
+			need += (ARROW_BATCH_ROWS + 1) * sizeof(int32_t) + 4096;
+			break;
+		case col_dict:
+			need += ARROW_BATCH_ROWS * sizeof(int32_t);
+			break;
+		case col_int64:
+		case col_timestamp:
+			need += ARROW_BATCH_ROWS * sizeof(int64_t);
+			break;
+		}
+		budget_need(need, "--arrow");
+		charged += need;
+
+		col->valid = calloc(ARROW_BATCH_ROWS / 8, 1);
+		if (col->valid == NULL)
+			my_panic(true, "calloc");
+		switch (colspecs[i].type) {
+		case col_utf8:
+			col->offsets = calloc(ARROW_BATCH_ROWS + 1,
+					      sizeof(int32_t));
+			col->datasize = 4096;
+			col->data = malloc(col->datasize);
+			if (col->offsets == NULL || col->data == NULL)
+				my_panic(true, "calloc");
+			break;
+		case col_dict:
+			col->indices = calloc(ARROW_BATCH_ROWS,
+					      sizeof(int32_t));
+			if (col->indices == NULL)
+				my_panic(true, "calloc");
+			break;
+		case col_int64:
+		case col_timestamp:
+			col->values = calloc(ARROW_BATCH_ROWS,
+					     sizeof(int64_t));
+			if (col->values == NULL)
+				my_panic(true, "calloc");
+			break;
+		}
+	}
+	rrtypes = hash_new();
+	started = true;
+	emit_schema();
+}
+
+/* batch_flush -- write out the rows accumulated so far and start over.
+ */
+static void
+batch_flush(void) {
+	size_t i;
+
+	if (ndict > dict_sent)
+		emit_dictionary();
+	body.nbufs = 0;
+	body.ob.len = 0;
+	emit_message(&meta, ARROW_HDR_RECORDBATCH, &body, fb_record_batch);
+
+	for (i = 0; i < NCOLS; i++) {
+		memset(columns[i].valid, 0, ARROW_BATCH_ROWS / 8);
+		columns[i].nulls = 0;
+		columns[i].datalen = 0;
+	}
+	nrows = 0;
+}
+
+/* column_str -- set one row of a string column, or make it null.
+ */
+static void
+column_str(struct column *col, size_t row, const char *str) {
+	size_t len;
+
+	if (str == NULL) {
+		col->nulls++;
+		col->offsets[row + 1] = (int32_t)col->datalen;
+		return;
+	}
+	len = strlen(str);
+	if (col->datalen + len > col->datasize) {
+		size_t old = col->datasize;
+
+		while (col->datalen + len > col->datasize)
+			col->datasize *= 2;
+		budget_need(col->datasize - old, "--arrow");
+		charged += col->datasize - old;
+		col->data = realloc(col->data, col->datasize);
+		if (col->data == NULL)
+			my_panic(true, "realloc");
+	}
+	memcpy(col->data + col->datalen, str, len);
+	col->datalen += len;
+	col->offsets[row + 1] = (int32_t)col->datalen;
+	col->valid[row / 8] |= (uint8_t)(1 << (row % 8));
+}
+
+/* column_int -- set one row of an integer column, or make it null if the
+ * tuple had no such field.
+ */
+static void
+column_int(struct column *col, size_t row, const json_t *present,
+	   int64_t value)
+{
+	if (present == NULL) {
+		col->nulls++;
+		col->values[row] = 0;
+		return;
+	}
+	col->values[row] = value;
+	col->valid[row / 8] |= (uint8_t)(1 << (row % 8));
+}
+
+/* emit_schema -- write the schema message that starts the stream.
+ */
+static void
+emit_schema(void) {
+	emit_message(&meta, ARROW_HDR_SCHEMA, NULL, fb_schema);
+}
+
+/* emit_dictionary -- write the rrtypes added since the last batch.
+ */
+static void
+emit_dictionary(void) {
+	struct obuf offsets = { NULL, 0, 0 }, data = { NULL, 0, 0 };
+	size_t i;
+	int32_t off = 0;
+
+	body.nbufs = 0;
+	body.ob.len = 0;
+	ob_put(&offsets, &off, sizeof off);
+	for (i = dict_sent; i < ndict; i++) {
+		ob_put(&data, dict_values[i], strlen(dict_values[i]));
+		off = (int32_t)data.len;
+		ob_put(&offsets, &off, sizeof off);
+	}
+	body_add(&body, NULL, 0);
+	body_add(&body, offsets.buf, offsets.len);
+	body_add(&body, data.buf, data.len);
+	ob_free(&offsets);
+	ob_free(&data);
+
+	emit_message(&meta, ARROW_HDR_DICTIONARY, &body, fb_dictionary);
+	dict_sent = ndict;
+}
+
+/* emit_message -- build one encapsulated IPC message and write it out.
+ *
+ * the metadata is a flatbuffer Message whose header table is built by
+ * the given function, which may also fill in the body; it is framed by a continuation marker and its
+ * length, padded to 8 bytes, and followed by the body.
+ */
+static void
+emit_message(struct obuf *fb, uint8_t header_type, struct body *bd,
+	     size_t (*header)(struct obuf *, struct body *))
+{
+	static const uint8_t cont[4] = { 0xff, 0xff, 0xff, 0xff };
+	struct fbfield fields[] = {
+		{ 0, 2, ARROW_METADATA_V5, 0 },
+		{ 1, 1, header_type, 0 },
+		{ 2, 4, 0, 0 },
+		{ 3, 8, 0, 0 },
+	};
+	size_t root, table;
+	uint8_t len[4];
+
+	fb->len = 0;
+	root = ob_put(fb, NULL, 4);
+	table = fb_table(fb, fields, sizeof fields / sizeof fields[0]);
+	fb_patch(fb, root, table);
+	fb_patch(fb, fields[2].pos, (*header)(fb, bd));
+	/* bodyLength is only known once the header has laid out the body. */
+	if (bd != NULL)
+		ob_le(fb, fields[3].pos, bd->ob.len, 8);
+	ob_pad(fb, 8, 0);
+
+	len[0] = (uint8_t)fb->len;
+	len[1] = (uint8_t)(fb->len >> 8);
+	len[2] = (uint8_t)(fb->len >> 16);
+	len[3] = (uint8_t)(fb->len >> 24);
+	fwrite(cont, 1, sizeof cont, arrow_out);
+	fwrite(len, 1, sizeof len, arrow_out);
+	fwrite(fb->buf, 1, fb->len, arrow_out);
+	if (bd != NULL)
+		fwrite(bd->ob.buf, 1, bd->ob.len, arrow_out);
+}
+
+/* fb_schema -- lay out the Schema table: one Field per column.
+ */
+static size_t
+fb_schema(struct obuf *fb, struct body *bd __attribute__ ((unused))) {
+	union { uint16_t u; uint8_t b[2]; } probe = { 1 };
+	struct fbfield fields[] = {
+		{ 0, 2, probe.b[0] == 1 ? 0 : 1, 0 },	/* endianness */
+		{ 1, 4, 0, 0 },				/* fields */
+	};
+	size_t table, vec, i;
+
+	table = fb_table(fb, fields, sizeof fields / sizeof fields[0]);
+	vec = fb_offsets(fb, NCOLS);
+	fb_patch(fb, fields[1].pos, vec);
+	for (i = 0; i < NCOLS; i++)
+		fb_patch(fb, vec + 4 + 4 * i, fb_field(fb, &colspecs[i]));
+	return table;
+}
+
+/* fb_field -- lay out one Field table and its type.
+ *
+ * a dictionary-encoded field has the type of its values (utf8) and says
+ * in its DictionaryEncoding how the indices are stored.
+ */
+static size_t
+fb_field(struct obuf *fb, const struct colspec *spec) {
+	struct fbfield fields[] = {
+		{ 0, 4, 0, 0 },		/* name */
+		{ 1, 1, 1, 0 },		/* nullable */
+		{ 2, 1, 0, 0 },		/* type_type */
+		{ 3, 4, 0, 0 },		/* type */
+		{ 5, 4, 0, 0 },		/* children */
+		{ 4, 4, 0, 0 },		/* dictionary */
+	};
+	size_t nfields = 5, table;
+
+	switch (spec->type) {
+	case col_utf8:
+		fields[2].value = ARROW_TYPE_UTF8;
+		break;
+	case col_dict:
+		fields[2].value = ARROW_TYPE_UTF8;
+		nfields = 6;
+		break;
+	case col_int64:
+		fields[2].value = ARROW_TYPE_INT;
+		break;
+	case col_timestamp:
+		fields[2].value = ARROW_TYPE_TIMESTAMP;
+		break;
+	}
+	table = fb_table(fb, fields, nfields);
+	fb_patch(fb, fields[0].pos, fb_string(fb, spec->name));
+	/* readers insist on a children vector, even an empty one. */
+	fb_patch(fb, fields[4].pos, fb_offsets(fb, 0));
+
+	switch (spec->type) {
+	case col_utf8: {
+		fb_patch(fb, fields[3].pos, fb_table(fb, NULL, 0));
+		break;
+	    }
+	case col_dict: {
+		struct fbfield dict[] = {
+			{ 0, 8, ARROW_RRTYPE_DICT, 0 },	/* id */
+			{ 1, 4, 0, 0 },			/* indexType */
+		};
+		size_t dtable;
+
+		fb_patch(fb, fields[3].pos, fb_table(fb, NULL, 0));
+		dtable = fb_table(fb, dict, sizeof dict / sizeof dict[0]);
+		fb_patch(fb, fields[5].pos, dtable);
+		fb_patch(fb, dict[1].pos, fb_int_type(fb, 32));
+		break;
+	    }
+	case col_int64:
+		fb_patch(fb, fields[3].pos, fb_int_type(fb, 64));
+		break;
+	case col_timestamp: {
+		struct fbfield ts[] = {
+			{ 0, 2, 0, 0 },		/* unit: SECOND */
+			{ 1, 4, 0, 0 },		/* timezone */
+		};
+
+		fb_patch(fb, fields[3].pos,
+			 fb_table(fb, ts, sizeof ts / sizeof ts[0]));
+		fb_patch(fb, ts[1].pos, fb_string(fb, "UTC"));
+		break;
+	    }
+	}
+	return table;
+}
+
+/* fb_int_type -- lay out a signed Int type table of the given width.
+ */
+static size_t
+fb_int_type(struct obuf *fb, int32_t bits) {
+	struct fbfield fields[] = {
+		{ 0, 4, (uint64_t)bits, 0 },	/* bitWidth */
+		{ 1, 1, 1, 0 },			/* is_signed */
+	};
+
+	return fb_table(fb, fields, sizeof fields / sizeof fields[0]);
+}
+
+/* fb_dictionary -- lay out a DictionaryBatch table for the body already
+ * built by emit_dictionary.
+ */
+static size_t
+fb_dictionary(struct obuf *fb, struct body *bd) {
+	struct fbfield fields[] = {
+		{ 0, 8, ARROW_RRTYPE_DICT, 0 },	/* id */
+		{ 1, 4, 0, 0 },			/* data */
+		{ 2, 1, dict_sent > 0, 0 },	/* isDelta */
+	};
+	uint64_t nodes[2] = { ndict - dict_sent, 0 };
+	struct fbfield rb[] = {
+		{ 0, 8, ndict - dict_sent, 0 },	/* length */
+		{ 1, 4, 0, 0 },			/* nodes */
+		{ 2, 4, 0, 0 },			/* buffers */
+	};
+	size_t table, rtable;
+
+	table = fb_table(fb, fields, sizeof fields / sizeof fields[0]);
+	rtable = fb_table(fb, rb, sizeof rb / sizeof rb[0]);
+	fb_patch(fb, fields[1].pos, rtable);
+	fb_patch(fb, rb[1].pos, fb_vector(fb, nodes, 1));
+	fb_patch(fb, rb[2].pos, fb_vector(fb, bd->desc, bd->nbufs));
+	return table;
+}
+
+/* fb_record_batch -- lay out the body for the current batch, then the
+ * RecordBatch table describing it.
+ */
+static size_t
+fb_record_batch(struct obuf *fb, struct body *bd) {
+	uint64_t nodes[NCOLS * 2];
+	struct fbfield fields[] = {
+		{ 0, 8, nrows, 0 },	/* length */
+		{ 1, 4, 0, 0 },		/* nodes */
+		{ 2, 4, 0, 0 },		/* buffers */
+	};
+	size_t table, i;
+
+	for (i = 0; i < NCOLS; i++) {
+		struct column *col = &columns[i];
+
+		nodes[2 * i] = nrows;
+		nodes[2 * i + 1] = col->nulls;
+		if (col->nulls == 0)
+			body_add(bd, NULL, 0);
+		else
+			body_add(bd, col->valid, (nrows + 7) / 8);
+		switch (colspecs[i].type) {
+		case col_utf8:
+			col->offsets[0] = 0;
+			body_add(bd, col->offsets,
+				 (nrows + 1) * sizeof(int32_t));
+			body_add(bd, col->data, col->datalen);
+			break;
+		case col_dict:
+			body_add(bd, col->indices, nrows * sizeof(int32_t));
+			break;
+		case col_int64:
+		case col_timestamp:
+			body_add(bd, col->values, nrows * sizeof(int64_t));
+			break;
+		}
+	}
+
+	table = fb_table(fb, fields, sizeof fields / sizeof fields[0]);
+	fb_patch(fb, fields[1].pos, fb_vector(fb, nodes, NCOLS));
+	fb_patch(fb, fields[2].pos, fb_vector(fb, bd->desc, bd->nbufs));
+	return table;
+}
+
+/* fb_table -- append a flatbuffer table, preceded by its vtable.
+ *
+ * fields are laid out largest first so each is naturally aligned; the
+ * table itself starts 8-aligned.  the position of each field is stored
+ * back into it so that offset fields can be patched once their target
+ * has been appended.
+ */
+static size_t
+fb_table(struct obuf *fb, struct fbfield *fields, size_t n) {
+	uint16_t vt[2 + FB_MAX_FIELDS], off[FB_MAX_FIELDS] = { 0 };
+	size_t nids = 0, size = 4, vtsize, vtable, table, i, k;
+	static const uint8_t sizes[] = { 8, 4, 2, 1 };
+
+	for (k = 0; k < sizeof sizes; k++)
+		for (i = 0; i < n; i++)
+			if (fields[i].size == sizes[k]) {
+				size = (size + sizes[k] - 1) &
+					~(size_t)(sizes[k] - 1);
+				off[i] = (uint16_t)size;
+				size += sizes[k];
+			}
+	for (i = 0; i < n; i++)
+		if (fields[i].id + 1U > nids)
+			nids = fields[i].id + 1U;
+	vtsize = 2 * (2 + nids);
+	memset(vt, 0, sizeof vt);
+	vt[0] = (uint16_t)vtsize;
+	vt[1] = (uint16_t)size;
+	for (i = 0; i < n; i++)
+		vt[2 + fields[i].id] = off[i];
+
+	ob_pad(fb, 8, vtsize);
+	vtable = fb->len;
+	ob_put(fb, NULL, vtsize);
+	for (i = 0; i < 2 + nids; i++)
+		ob_le(fb, vtable + 2 * i, vt[i], 2);
+	table = ob_put(fb, NULL, size);
+	ob_le(fb, table, table - vtable, 4);
+	for (i = 0; i < n; i++) {
+		fields[i].pos = table + off[i];
+		ob_le(fb, fields[i].pos, fields[i].value, fields[i].size);
+	}
+	return table;
+}
+
+/* fb_vector -- append a vector of 16-byte structs, each two int64s.
+ */
+static size_t
+fb_vector(struct obuf *fb, const uint64_t *pairs, size_t n) {
+	size_t vec, i;
+
+	ob_pad(fb, 8, 4);
+	vec = ob_put(fb, NULL, 4 + 16 * n);
+	ob_le(fb, vec, n, 4);
+	for (i = 0; i < 2 * n; i++)
+		ob_le(fb, vec + 4 + 8 * i, pairs[i], 8);
+	return vec;
+}
+
+/* fb_offsets -- append a vector of n offsets, to be patched later.
+ */
+static size_t
+fb_offsets(struct obuf *fb, size_t n) {
+	size_t vec;
+
+	ob_pad(fb, 4, 0);
+	vec = ob_put(fb, NULL, 4 + 4 * n);
+	ob_le(fb, vec, n, 4);
+	return vec;
+}
+
+/* fb_string -- append a NUL-terminated flatbuffer string.
+ */
+static size_t
+fb_string(struct obuf *fb, const char *str) {
+	size_t len = strlen(str), pos;
+
+	ob_pad(fb, 4, 0);
+	pos = ob_put(fb, NULL, 4 + len + 1);
+	ob_le(fb, pos, len, 4);
+	memcpy(fb->buf + pos + 4, str, len);
+	return pos;
+}
+
+/* fb_patch -- point the offset at pos forward to target.
+ */
+static void
+fb_patch(struct obuf *fb, size_t pos, size_t target) {
+	ob_le(fb, pos, target - pos, 4);
+}
+
+/* body_add -- append one buffer to a message body, 8-aligned.
+ */
+static void
+body_add(struct body *bd, const void *data, size_t len) {
+	ob_pad(&bd->ob, 8, 0);
+	bd->desc[2 * bd->nbufs] = bd->ob.len;
+	bd->desc[2 * bd->nbufs + 1] = len;
+	bd->nbufs++;
+	ob_put(&bd->ob, data, len);
+	ob_pad(&bd->ob, 8, 0);
+}
+
+/* ob_pad -- zero fill until len + extra is a multiple of align.
+ */
+static void
+ob_pad(struct obuf *ob, size_t align, size_t extra) {
+	size_t pad = (align - (ob->len + extra) % align) % align;
+
+	ob_put(ob, NULL, pad);
+}
+
+/* ob_put -- append n bytes (zeros if data is NULL); return where.
+ */
+static size_t
+ob_put(struct obuf *ob, const void *data, size_t n) {
+	size_t pos = ob->len;
+
+	if (ob->len + n > ob->size) {
+		size_t old = ob->size;
+
+		if (ob->size == 0)
+			ob->size = 1024;
+		while (ob->len + n > ob->size)
+			ob->size *= 2;
+		budget_need(ob->size - old, "--arrow");
+		ob->buf = realloc(ob->buf, ob->size);
+		if (ob->buf == NULL)
+			my_panic(true, "realloc");
+	}
+	if (data != NULL)
+		memcpy(ob->buf + pos, data, n);
+	else
+		memset(ob->buf + pos, 0, n);
+	ob->len += n;
+	return pos;
+}
+
+/* ob_free -- release an output buffer.
+ */
+static void
+ob_free(struct obuf *ob) {
+	budget_give(ob->size);
+	DESTROY(ob->buf);
+	ob->len = ob->size = 0;
+}
+
+/* ob_le -- store an n-byte little-endian integer at pos.
+ */
+static void
+ob_le(struct obuf *ob, size_t pos, uint64_t value, size_t n) {
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		ob->buf[pos + i] = (uint8_t)(value >> (8 * i));
+}
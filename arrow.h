@@ -0,0 +1,28 @@
+/*
+ * Copyright (c) 2014-2020 by Farsight Security, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ARROW_H_INCLUDED
+#define ARROW_H_INCLUDED 1
+
+#include "pdns.h"
+
+/* rows per Arrow record batch; memory use is bounded by one batch */
+#define ARROW_BATCH_ROWS 65536
+
+void present_arrow(pdns_tuple_ct, const char *, size_t, sink_t);
+void arrow_fini(sink_t);
+
+#endif /*ARROW_H_INCLUDED*/
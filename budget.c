@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2014-2020 by Farsight Security, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+
+#include "defs.h"
+#include "pdns.h"
+#include "budget.h"
+#include "globals.h"
+
+/* bytes drawn on the --max-memory budget now, and at most.  only the
+ * main thread draws on the budget.
+ */
+static size_t used = 0, peak = 0;
+
+/* budget_take -- draw n bytes on the budget.
+ *
+ * returns false, drawing nothing, if that would exceed --max-memory.
+ */
+bool
+budget_take(size_t n) {
+	if (max_memory != 0 && n > max_memory - used)
+		return false;
+	used += n;
+	if (used > peak)
+		peak = used;
+	return true;
+}
+
+/* budget_need -- draw n bytes on the budget for what, or exit.
+ */
+void
+budget_need(size_t n, const char *what) {
+	if (!budget_take(n)) {
+		my_logf("--max-memory: %s needs %zu more bytes,"
+			" but %zu of %zu are in use",
+			what, n, used, max_memory);
+		my_exit(1);
+	}
+}
+
+/* budget_give -- return n bytes to the budget.
+ */
+void
+budget_give(size_t n) {
+	used = (n > used) ? 0 : used - n;
+}
+
+/* budget_resize -- change an allocation's draw on the budget from *have
+ * bytes to want bytes.
+ *
+ * returns false, changing nothing, if growing would exceed --max-memory.
+ */
+bool
+budget_resize(size_t *have, size_t want) {
+	if (want > *have) {
+		if (!budget_take(want - *have))
+			return false;
+	} else {
+		budget_give(*have - want);
+	}
+	*have = want;
+	return true;
+}
+
+/* budget_report -- tell how close to the budget we came.
+ */
+void
+budget_report(void) {
+	if (max_memory != 0 && !quiet)
+		my_logf("--max-memory: peak %zu of %zu bytes", peak, max_memory);
+}
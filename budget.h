@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2014-2020 by Farsight Security, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BUDGET_H_INCLUDED
+#define BUDGET_H_INCLUDED 1
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* --max-memory may not be set below this; one receive block from libcurl
+ * plus the fixed tables of the presenters must fit.
+ */
+#define BUDGET_MIN (1024*1024)
+
+bool budget_take(size_t);
+void budget_need(size_t, const char *);
+void budget_give(size_t);
+bool budget_resize(size_t *, size_t);
+void budget_report(void);
+
+#endif /*BUDGET_H_INCLUDED*/
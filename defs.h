@@ -26,6 +26,10 @@
 
 #define DEFAULT_SYS "dnsdb2"
 #define DNSDBQ_SYSTEM "DNSDBQ_SYSTEM"
+/* what --fanout-rrtypes queries when not given a list. */
+#define FANOUT_RRTYPES "A,AAAA,CNAME,NS,MX,TXT,PTR,SOA"
+/* exit status when --deadline cut the output short. */
+#define DEADLINE_EXIT 3
 
 #define CREATE(p, s) if ((p) != NULL) { my_panic(false, "non-NULL ptr"); } \
 	else if (((p) = malloc(s)) == NULL) { my_panic(true, "malloc"); } \
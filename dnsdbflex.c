@@ -53,7 +53,25 @@
 #if WANT_PDNS_DNSDB2
 #include "pdns_dnsdb.h"
 #endif
+#include "ns_ttl.h"
 #include "time.h"
+#include "aggregate.h"
+#include "aimd.h"
+#include "budget.h"
+#include "endpoint.h"
+#include "exhaustive.h"
+#include "input.h"
+#include "merge.h"
+#include "plan.h"
+#include "plugin.h"
+#include "quota.h"
+#include "sample.h"
+#include "sched.h"
+#include "shard.h"
+#include "sqlite.h"
+#include "sink.h"
+#include "suffix.h"
+#include "regset.h"
 #include "globals.h"
 #undef MAIN_PROGRAM
 
@@ -64,12 +82,19 @@ static pdns_system_ct pick_system(const char *);
 static void qdesc_debug(const char *, qdesc_ct);
 static __attribute__((noreturn)) void usage(const char *, ...);
 static bool parse_long(const char *, long *);
+static bool parse_size(const char *, size_t *);
+static bool parse_duration(const char *, long *);
 static void set_timeout(const char *, const char *);
 static void read_configs(void);
 static char *makepath(qdesc_ct);
-static void query_launcher(qdesc_ct, writer_t);
 static const char *check_printable_ascii(const char *);
 static void check_glob_trailing_char(bool, qdesc_ct);
+static void read_exclude_file(const char *, qdesc_t);
+static bool exclude_pushdown(qdesc_t, const char *);
+static void read_match_file(const char *);
+static const char *parse_fanout(const char *);
+static void check_quota(size_t, bool, const char *);
+static void run_queries(struct qdesc *, writer_t *, size_t, long);
 
 /* Constants. */
 
@@ -84,6 +109,10 @@ static const char * const conf_files[] = {
 /* Private. */
 
 static bool force_query = false;
+static size_t exclude_pushed = 0, exclude_shared = 0;
+static char **fanout_types = NULL;
+static size_t nfanout = 0;
+static enum { quota_check, quota_ignore, quota_off } quota_mode = quota_check;
 
 /* Public. */
 
@@ -95,6 +124,29 @@ main(int argc, char *argv[]) {
 		.after = 0, .before = 0, .complete = false,
 		.query_limit = -1, .output_limit = -1, .offset = 0 };
 	const char *msg;
+	const char *exclude_file = NULL;
+	const char *plugin_path = NULL, *plugin_arg = NULL;
+	const char **inputs = NULL;
+	size_t ninputs = 0;
+	const char *shard_verify_path = NULL, *run_shard = NULL;
+	const char *merge_key_arg = NULL, *batch_path = NULL;
+	bool merge = false, merge_count = false, merge_times = false;
+	char **merge_paths = NULL;
+	size_t nmerge = 0;
+	merge_key_e merge_key = merge_rrname;
+	long plan_windows = 0;
+	struct qdesc *shards = NULL, *queries = NULL;
+	size_t nqueries = 0;
+	long input_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	long sample_n = 0;
+	bool presentation_given = false;
+	const char **outputs = NULL;
+	size_t noutputs = 0, i;
+#ifdef WANT_SQLITE
+	const char *sqlite_arg = NULL;
+	long sqlite_batch = SQLITE_BATCH_ROWS;
+	bool sqlite_upsert = false;
+#endif
 	int ch;
 	size_t sz;
 
@@ -114,28 +166,137 @@ main(int argc, char *argv[]) {
 	/* All the getopt_long switches use the following enum */
 	static enum {
 		long_opt_none,		/* nothing specified */
+		long_opt_aggregate,	/* --aggregate */
+		long_opt_arrow,		/* --arrow */
+		long_opt_batch,		/* --batch */
+		long_opt_collapse,	/* --collapse */
+		long_opt_count,		/* --count */
+		long_opt_deadline,	/* --deadline */
+		long_opt_dedup,		/* --dedup */
 		long_opt_exclude,	/* --exclude */
+		long_opt_exclude_file,	/* --exclude-file */
+		long_opt_exhaustive,	/* --exhaustive */
+		long_opt_fanout_rrtypes, /* --fanout-rrtypes */
 		long_opt_force,		/* --force */
 		long_opt_glob,		/* --glob */
+		long_opt_hedge,		/* --hedge */
+		long_opt_hedge_budget,	/* --hedge-budget */
+		long_opt_input,		/* --input */
+		long_opt_match_file,	/* --match-file */
+		long_opt_max_memory,	/* --max-memory */
+		long_opt_merge,		/* --merge */
+		long_opt_merge_count,	/* --merge-count */
+		long_opt_merge_key,	/* --merge-key */
+		long_opt_merge_times,	/* --merge-times */
 		long_opt_mode,		/* --mode */
+		long_opt_output,	/* --output */
+		long_opt_plan,		/* --plan */
+		long_opt_plugin_arg,	/* --plugin-arg */
+		long_opt_presenter_plugin, /* --presenter-plugin */
+		long_opt_quota,		/* --quota */
+		long_opt_raw,		/* --raw */
 		long_opt_regex,		/* --regex */
-		long_opt_timeout	/* --timeout */
+		long_opt_run_shard,	/* --run-shard */
+		long_opt_sample,	/* --sample */
+		long_opt_shard,		/* --shard */
+		long_opt_shard_verify,	/* --shard-verify */
+		long_opt_sketch,	/* --sketch */
+#ifdef WANT_SQLITE
+		long_opt_sqlite,	/* --sqlite */
+		long_opt_sqlite_batch,	/* --sqlite-batch */
+		long_opt_sqlite_upsert,	/* --sqlite-upsert */
+#endif
+		long_opt_threads,	/* --threads */
+		long_opt_timeout,	/* --timeout */
+		long_opt_timings	/* --timings */
 	} long_opt_switch = long_opt_none;
 
 	static struct option long_options[] = {
 		/* NAME	    ARGUMENT	       FLAG  SHORTNAME */
+		{"aggregate", required_argument, (int*)&long_opt_switch,
+		 long_opt_aggregate},
+		{"arrow",   no_argument,       (int*)&long_opt_switch,
+		 long_opt_arrow},
+		{"batch",   required_argument, (int*)&long_opt_switch,
+		 long_opt_batch},
+		{"collapse", no_argument,       (int*)&long_opt_switch,
+		 long_opt_collapse},
+		{"count",   no_argument,       (int*)&long_opt_switch,
+		 long_opt_count},
+		{"deadline", required_argument, (int*)&long_opt_switch,
+		 long_opt_deadline},
+		{"dedup",   no_argument,       (int*)&long_opt_switch,
+		 long_opt_dedup},
 		{"exclude", required_argument, (int*)&long_opt_switch,
 		 long_opt_exclude},
+		{"exclude-file", required_argument, (int*)&long_opt_switch,
+		 long_opt_exclude_file},
+		{"exhaustive", no_argument,    (int*)&long_opt_switch,
+		 long_opt_exhaustive},
+		{"fanout-rrtypes", optional_argument, (int*)&long_opt_switch,
+		 long_opt_fanout_rrtypes},
 		{"force",   no_argument,       (int*)&long_opt_switch,
 		 long_opt_force},
 		{"glob",    required_argument, (int*)&long_opt_switch,
 		 long_opt_glob},
+		{"hedge",   required_argument, (int*)&long_opt_switch,
+		 long_opt_hedge},
+		{"hedge-budget", required_argument, (int*)&long_opt_switch,
+		 long_opt_hedge_budget},
+		{"input",   required_argument, (int*)&long_opt_switch,
+		 long_opt_input},
+		{"match-file", required_argument, (int*)&long_opt_switch,
+		 long_opt_match_file},
+		{"max-memory", required_argument, (int*)&long_opt_switch,
+		 long_opt_max_memory},
+		{"merge",   no_argument,       (int*)&long_opt_switch,
+		 long_opt_merge},
+		{"merge-count", no_argument,   (int*)&long_opt_switch,
+		 long_opt_merge_count},
+		{"merge-key", required_argument, (int*)&long_opt_switch,
+		 long_opt_merge_key},
+		{"merge-times", no_argument,   (int*)&long_opt_switch,
+		 long_opt_merge_times},
 		{"mode",    required_argument, (int*)&long_opt_switch,
 		 long_opt_mode},
+		{"output",  required_argument, (int*)&long_opt_switch,
+		 long_opt_output},
+		{"plan",    required_argument, (int*)&long_opt_switch,
+		 long_opt_plan},
+		{"plugin-arg", required_argument, (int*)&long_opt_switch,
+		 long_opt_plugin_arg},
+		{"presenter-plugin", required_argument, (int*)&long_opt_switch,
+		 long_opt_presenter_plugin},
+		{"quota",   required_argument, (int*)&long_opt_switch,
+		 long_opt_quota},
+		{"raw",     no_argument,       (int*)&long_opt_switch,
+		 long_opt_raw},
 		{"regex",   required_argument, (int*)&long_opt_switch,
 		 long_opt_regex},
+		{"run-shard", required_argument, (int*)&long_opt_switch,
+		 long_opt_run_shard},
+		{"sample",  required_argument, (int*)&long_opt_switch,
+		 long_opt_sample},
+		{"shard",   required_argument, (int*)&long_opt_switch,
+		 long_opt_shard},
+		{"shard-verify", required_argument, (int*)&long_opt_switch,
+		 long_opt_shard_verify},
+		{"sketch",  no_argument,       (int*)&long_opt_switch,
+		 long_opt_sketch},
+#ifdef WANT_SQLITE
+		{"sqlite",  required_argument, (int*)&long_opt_switch,
+		 long_opt_sqlite},
+		{"sqlite-batch", required_argument, (int*)&long_opt_switch,
+		 long_opt_sqlite_batch},
+		{"sqlite-upsert", no_argument, (int*)&long_opt_switch,
+		 long_opt_sqlite_upsert},
+#endif
+		{"threads", required_argument, (int*)&long_opt_switch,
+		 long_opt_threads},
 		{"timeout",   required_argument, (int*)&long_opt_switch,
 		 long_opt_timeout},
+		{"timings", no_argument,       (int*)&long_opt_switch,
+		 long_opt_timings},
 		{NULL,	    0,			NULL, 0}
 	};
 
@@ -156,6 +317,13 @@ main(int argc, char *argv[]) {
 			 * the common variable all the long options set.
 			 */
 			switch (long_opt_switch) {
+			case long_opt_aggregate:
+				msg = aggregate_parse(optarg);
+				if (msg != NULL)
+					usage(msg);
+				presentation = pres_aggregate;
+				presentation_given = true;
+				break;
 			case long_opt_timeout:
 				sz = strlen(optarg);
 				if (sz == 0)
@@ -167,6 +335,9 @@ main(int argc, char *argv[]) {
 					      MAX_VALUE_LEN);
 				set_timeout(optarg, "--timeout");
 				break;
+			case long_opt_timings:
+				timings = true;
+				break;
 			case long_opt_regex:
 				sz = strlen(optarg);
 				if (sz == 0)
@@ -197,6 +368,138 @@ main(int argc, char *argv[]) {
 				qd.value = strdup(optarg);
 				qd.search_method = method_glob;
 				break;
+			case long_opt_arrow:
+				presentation = pres_arrow;
+				presentation_given = true;
+				break;
+			case long_opt_collapse:
+				presentation = pres_json_grouped;
+				presentation_given = true;
+				break;
+			case long_opt_sketch:
+				presentation = pres_sketch;
+				presentation_given = true;
+				break;
+#ifdef WANT_SQLITE
+			case long_opt_sqlite:
+				sqlite_arg = optarg;
+				presentation = pres_sqlite;
+				presentation_given = true;
+				break;
+			case long_opt_sqlite_batch:
+				if (!parse_long(optarg, &sqlite_batch) ||
+				    sqlite_batch <= 0)
+					usage("--sqlite-batch must be positive");
+				break;
+			case long_opt_sqlite_upsert:
+				sqlite_upsert = true;
+				break;
+#endif
+			case long_opt_output:
+				outputs = realloc(outputs, (noutputs + 1) *
+						  sizeof *outputs);
+				if (outputs == NULL)
+					my_panic(true, "realloc");
+				outputs[noutputs++] = optarg;
+				break;
+			case long_opt_input:
+				if (*optarg == '\0')
+					usage("The --input option requires"
+					      " a non-empty argument");
+				inputs = realloc(inputs, (ninputs + 1) *
+						 sizeof *inputs);
+				if (inputs == NULL)
+					my_panic(true, "realloc");
+				inputs[ninputs++] = optarg;
+				break;
+			case long_opt_dedup:
+				dedup = true;
+				break;
+			case long_opt_hedge:
+				if (strcmp(optarg, "auto") == 0)
+					hedge_ms = -1L;
+				else if (!parse_long(optarg, &hedge_ms) ||
+					 hedge_ms <= 0)
+					usage("--hedge must be a positive number"
+					      " of milliseconds, or auto");
+				break;
+			case long_opt_hedge_budget:
+				if (!parse_long(optarg, &hedge_pct) ||
+				    hedge_pct <= 0 || hedge_pct > 100)
+					usage("--hedge-budget must be a percentage"
+					      " from 1 to 100");
+				break;
+			case long_opt_deadline:
+				if (!parse_duration(optarg, &deadline_ms))
+					usage("--deadline must be a positive"
+					      " duration");
+				break;
+			case long_opt_batch:
+				batch_path = optarg;
+				break;
+			case long_opt_quota:
+				if (strcmp(optarg, "ignore") == 0)
+					quota_mode = quota_ignore;
+				else if (strcmp(optarg, "off") == 0)
+					quota_mode = quota_off;
+				else if (strncmp(optarg, "defer:", 6) == 0 &&
+					 optarg[6] != '\0')
+					quota_defer = optarg + 6;
+				else
+					usage("--quota must be ignore, off, or"
+					      " defer:FILE");
+				break;
+			case long_opt_plan:
+				if (!parse_long(optarg, &plan_windows) ||
+				    plan_windows <= 0)
+					usage("--plan must be positive");
+				break;
+			case long_opt_run_shard:
+				run_shard = optarg;
+				break;
+			case long_opt_threads:
+				if (!parse_long(optarg, &input_threads) ||
+				    input_threads <= 0)
+					usage("--threads must be positive");
+				break;
+			case long_opt_presenter_plugin:
+				plugin_path = optarg;
+				presentation = pres_plugin;
+				presentation_given = true;
+				break;
+			case long_opt_raw:
+				raw_output = true;
+				break;
+			case long_opt_count:
+				count_only = true;
+				break;
+			case long_opt_exhaustive:
+				exhaustive = true;
+				break;
+			case long_opt_shard:
+				if (!parse_long(optarg, &nshards) ||
+				    nshards < SHARD_MIN || nshards > SHARD_MAX)
+					usage("--shard must be between %d"
+					      " and %ld", SHARD_MIN,
+					      SHARD_MAX);
+				break;
+			case long_opt_shard_verify:
+				shard_verify_path = optarg;
+				break;
+			case long_opt_fanout_rrtypes:
+				msg = parse_fanout(or_else(optarg,
+							   FANOUT_RRTYPES));
+				if (msg != NULL)
+					usage(msg);
+				break;
+			case long_opt_plugin_arg:
+				plugin_arg = optarg;
+				break;
+			case long_opt_sample:
+				if (!parse_long(optarg, &sample_n) ||
+				    sample_n <= 0)
+					usage("--sample must be positive");
+				break;
 			case long_opt_exclude:
 				sz = strlen(optarg);
 				if (sz == 0)
@@ -212,6 +515,42 @@ main(int argc, char *argv[]) {
 					      " more than once");
 				qd.exclude = strdup(optarg);
 				break;
+			case long_opt_exclude_file:
+				if (*optarg == '\0')
+					usage("The --exclude-file option requires"
+					      " a non-empty argument");
+				if (exclude_file != NULL)
+					usage("Cannot specify --exclude-file"
+					      " more than once");
+				exclude_file = optarg;
+				break;
+			case long_opt_match_file:
+				if (*optarg == '\0')
+					usage("The --match-file option requires"
+					      " a non-empty argument");
+				if (match_set != NULL)
+					usage("Cannot specify --match-file"
+					      " more than once");
+				read_match_file(optarg);
+				break;
+			case long_opt_max_memory:
+				if (!parse_size(optarg, &max_memory) ||
+				    max_memory < BUDGET_MIN)
+					usage("--max-memory must be a size"
+					      " of at least 1M");
+				break;
+			case long_opt_merge:
+				merge = true;
+				break;
+			case long_opt_merge_count:
+				merge_count = true;
+				break;
+			case long_opt_merge_key:
+				merge_key_arg = optarg;
+				break;
+			case long_opt_merge_times:
+				merge_times = true;
+				break;
 			case long_opt_force:
 				force_query = true;
 				break;
@@ -261,12 +600,14 @@ main(int argc, char *argv[]) {
 			break;
 		case 'F':
 			presentation = pres_batch;
+			presentation_given = true;
 			break;
 		case 'h':
 			help();
 			my_exit(0);
 		case 'j':
 			presentation = pres_json;
+			presentation_given = true;
 			break;
 		case 'l':
 			if (!parse_long(optarg, &qd.query_limit) ||
@@ -304,6 +645,7 @@ main(int argc, char *argv[]) {
 			break;
 		case 'T':
 			presentation = pres_batch_dedup_rrtype;
+			presentation_given = true;
 			break;
 		case 'u':
 			if ((psys = pick_system(optarg)) == NULL)
@@ -327,20 +669,97 @@ main(int argc, char *argv[]) {
 	}
 
 	argc -= optind;
-	if (argc != 0)
+	if (merge) {
+		/* --merge takes its input files as the arguments. */
+		if (argc == 0)
+			usage("--merge needs one or more files");
+		merge_paths = argv + optind;
+		nmerge = (size_t)argc;
+		if (qd.value != NULL || qd.exclude != NULL ||
+		    ninputs != 0 || run_shard != NULL || nshards != 0 ||
+		    plan_windows != 0 || nfanout != 0 || exhaustive ||
+		    raw_output || count_only || dedup)
+			usage("--merge reads saved results, so query options,"
+			      " --input, --raw, --count, and --dedup do not"
+			      " apply");
+		/* the key defaults to what -s says was searched. */
+		merge_key = (qd.what_to_search == search_rdata)
+			? merge_rdata : merge_rrname;
+		if (merge_key_arg != NULL &&
+		    (msg = merge_key_parse(merge_key_arg, &merge_key)) != NULL)
+			usage(msg);
+	} else if (argc != 0) {
 		usage("there are no non-option arguments to this program");
+	} else if (merge_key_arg != NULL || merge_count || merge_times) {
+		usage("--merge-key, --merge-count, and --merge-times"
+		      " need --merge");
+	}
 	argv = NULL;
 
-	if (qd.value == NULL)
+	/* --run-shard takes the whole query from a --plan descriptor. */
+	if (run_shard != NULL) {
+		if (qd.value != NULL || qd.exclude != NULL ||
+		    qd.rrtype != NULL || qd.after != 0 || qd.before != 0 ||
+		    qd.complete || nshards != 0 || nfanout != 0 ||
+		    plan_windows != 0 || ninputs != 0)
+			usage("--run-shard takes its query from the descriptor,"
+			      " so no other query options apply");
+		if ((msg = plan_load(run_shard, &qd)) != NULL)
+			usage("--run-shard: %s", msg);
+	}
+
+	/* --batch runs the queries in a file of descriptors. */
+	if (batch_path != NULL) {
+		size_t lineno;
+
+		if (qd.value != NULL || qd.exclude != NULL ||
+		    qd.rrtype != NULL || qd.after != 0 || qd.before != 0 ||
+		    qd.complete || nshards != 0 || nfanout != 0 ||
+		    plan_windows != 0 || ninputs != 0 || merge ||
+		    run_shard != NULL || exhaustive)
+			usage("--batch takes its queries from the descriptors,"
+			      " so no other query options apply");
+		if ((msg = sched_load(batch_path, &lineno)) != NULL)
+			usage("--batch: %s: line %zu: %s", batch_path, lineno,
+			      msg);
+		batch_run = true;
+	}
+	if (quota_defer != NULL && !batch_run)
+		usage("--quota defer:FILE needs --batch");
+
+	if (merge || batch_run) {
+		/* checked above. */
+	} else if (ninputs != 0) {
+		if (qd.value != NULL || qd.exclude != NULL)
+			usage("--input reads saved results, so --regex,"
+			      " --glob, and --exclude do not apply");
+		if (qd.query_limit != -1 || qd.output_limit != -1 ||
+		    qd.offset != 0)
+			usage("--input reads saved results, so -l, -L,"
+			      " and -O do not apply");
+	} else if (qd.value == NULL)
 		usage("Need to provide a --regex or --glob option and"
 		      " its argument");
 
+	/* each --batch query is checked as if it were given here. */
+	for (i = 0; i < sched_count(); i++) {
+		qdesc_ct qdp = sched_query(i);
+
+		if (qdp->search_method == method_glob)
+			check_glob_trailing_char(force_query, qdp);
+		if (!force_query &&
+		    ((msg = check_printable_ascii(qdp->value)) != NULL ||
+		     (qdp->exclude != NULL &&
+		      (msg = check_printable_ascii(qdp->exclude)) != NULL)))
+			usage("--batch: %s", msg);
+	}
+
 	if (qd.search_method == method_glob)
 		check_glob_trailing_char(force_query, &qd);
-	else if (force_query)
+	else if (force_query && !batch_run)
 		usage("--force only makes sense with a glob query");
 
-	if (!force_query) {
+	if (!force_query && qd.value != NULL) {
 		msg = check_printable_ascii(qd.value);
 		if (msg != NULL)
 			usage(msg);
@@ -352,10 +771,124 @@ main(int argc, char *argv[]) {
 		}
 	}
 
+	if (exclude_file != NULL)
+		read_exclude_file(exclude_file, &qd);
+
+	/* --raw and --count do not parse results, so nothing can be done
+	 * to them.
+	 */
+	if (raw_output && count_only)
+		usage("--raw and --count are mutually exclusive");
+	if ((raw_output || count_only) && dedup)
+		usage("--raw and --count do not parse results, so --dedup"
+		      " does not apply");
+	if (raw_output || count_only) {
+		if (presentation_given || noutputs != 0 || sample_n != 0 ||
+		    match_set != NULL || ninputs != 0)
+			usage("--raw and --count cannot be combined with output"
+			      " forms, --sample, --match-file, or --input");
+		if (exclude_suffixes != NULL &&
+		    exclude_suffixes->nsuffixes != 0)
+			usage("--raw and --count need every --exclude-file"
+			      " suffix to be excluded by the server");
+	}
+
+	if ((deadline_ms != 0 || hedge_ms != 0 || timings) &&
+	    (ninputs != 0 || merge))
+		usage("--deadline, --hedge and --timings are for queries, so"
+		      " --input and --merge do not apply");
+
+	if (nfanout != 0 && qd.rrtype != NULL)
+		usage("-t and --fanout-rrtypes are mutually exclusive");
+
+	/* --shard splits the pattern into disjoint ones; --shard-verify
+	 * checks that on saved results instead of querying.
+	 */
+	if (shard_verify_path != NULL && nshards == 0)
+		usage("--shard-verify needs --shard");
+	if (nshards != 0) {
+		if (ninputs != 0)
+			usage("--input makes no query to --shard");
+		if ((msg = shard_plan(&qd, nshards, &shards)) != NULL)
+			usage(msg);
+		if (shard_verify_path != NULL) {
+			shard_verify(&qd, shards, (size_t)nshards,
+				     shard_verify_path);
+			shard_free(shards, (size_t)nshards);
+			DESTROY(qd.value);
+			my_exit(exit_code);
+		}
+	}
+
+	/* --plan prints shard descriptors for --run-shard and stops. */
+	if (plan_windows != 0) {
+		u_long after, before;
+
+		if (ninputs != 0)
+			usage("--input makes no query to --plan");
+		if (match_set != NULL ||
+		    (exclude_suffixes != NULL &&
+		     exclude_suffixes->nsuffixes != 0))
+			usage("--plan descriptors carry only what the server"
+			      " filters, so --match-file and --exclude-file"
+			      " suffixes kept locally do not apply");
+		if ((plan_windows > 1 &&
+		     !exhaustive_range(&qd, &after, &before)) ||
+		    (qd.after != 0 && qd.before != 0 && qd.after >= qd.before))
+			usage("-A value must be before -B value (or now, without"
+			      " -B) with --plan");
+		if (qd.complete && plan_windows > 1)
+			usage("--plan needs overlapping time matching to split"
+			      " the time range, so -c does not apply");
+		if (nshards != 0)
+			plan_emit(&qd, shards, (size_t)nshards, fanout_types,
+				  nfanout, plan_windows);
+		else
+			plan_emit(&qd, &qd, 1, fanout_types, nfanout,
+				  plan_windows);
+		shard_free(shards, (size_t)nshards);
+		for (i = 0; i < nfanout; i++)
+			DESTROY(fanout_types[i]);
+		DESTROY(fanout_types);
+		DESTROY(qd.value);
+		DESTROY(qd.exclude);
+		DESTROY(qd.rrtype);
+		my_exit(exit_code);
+	}
+
+	/* --exhaustive splits the -A/-B range into windows of its own and
+	 * needs to see the server's "limited" in each.
+	 */
+	if (exhaustive) {
+		u_long after, before;
+
+		if (ninputs != 0 || raw_output || count_only)
+			usage("--exhaustive cannot be combined with --input,"
+			      " --raw, or --count");
+		if (qd.complete)
+			usage("--exhaustive needs overlapping time matching,"
+			      " so -c does not apply");
+		if (qd.output_limit != -1 || qd.offset != 0)
+			usage("-L and -O do not apply to --exhaustive");
+		if (!exhaustive_range(&qd, &after, &before))
+			usage("-A value must be before -B value (or now, without"
+			      " -B) with --exhaustive");
+	}
+
 	/* recondition for HTML use. */
 	CURL *easy = curl_easy_init();
 	escape(easy, &qd.value);
+	escape(easy, &qd.exclude);
 	escape(easy, &qd.rrtype);
+	for (i = 0; i < (size_t)nshards; i++) {
+		escape(easy, &shards[i].value);
+		escape(easy, &shards[i].exclude);
+	}
+	for (i = 0; i < sched_count(); i++) {
+		escape(easy, &sched_query(i)->value);
+		escape(easy, &sched_query(i)->exclude);
+		escape(easy, &sched_query(i)->rrtype);
+	}
 	curl_easy_cleanup(easy);
 	easy = NULL;
 
@@ -375,51 +908,188 @@ main(int argc, char *argv[]) {
 		qdesc_debug("main", &qd);
 	}
 
-	/* select presenter. */
-	switch (presentation) {
-	case pres_json:
-		presenter = present_json;
-		break;
-	case pres_batch:
-		presenter = present_batch;
-		break;
-	case pres_batch_dedup_rrtype:
-		presenter = present_batch_dedup_rrtype;
-		break;
-	default:
-		abort();
+	/* set up the sinks: the stdout presentation unless only --output
+	 * was given, then each --output FORMAT:FILE.
+	 */
+#ifdef WANT_SQLITE
+	if (presentation == pres_sqlite &&
+	    (msg = sqlite_open(sqlite_arg, sqlite_batch,
+			       sqlite_upsert)) != NULL)
+		usage(msg);
+#endif
+	if (presentation == pres_plugin &&
+	    (msg = plugin_load(plugin_path, plugin_arg)) != NULL)
+		usage(msg);
+	/* with --raw or --count, output goes straight from netio to stdout. */
+	if (!raw_output && !count_only &&
+	    (noutputs == 0 || presentation_given)) {
+		if ((msg = sink_add(presentation, NULL)) != NULL)
+			usage(msg);
 	}
-
-	/* get to final readiness; in particular, get psys set. */
-	read_configs();
-	if (psys == NULL) {
-		psys = pick_system(DEFAULT_SYS);
-		if (psys == NULL)
-			usage("neither " DNSDBQ_SYSTEM
-			      " nor -u were specified,"
-			      " and there is no default.");
+	for (i = 0; i < noutputs; i++) {
+		const char *colon = strchr(outputs[i], ':');
+		present_e format;
+		char *name;
+
+		if (colon == NULL || colon[1] == '\0')
+			usage("--output needs FORMAT:FILE");
+		name = strndup(outputs[i], (size_t)(colon - outputs[i]));
+		if ((msg = sink_format(name, &format)) != NULL)
+			usage(msg);
+		DESTROY(name);
+		if ((msg = sink_add(format, colon + 1)) != NULL)
+			usage(msg);
+	}
+	DESTROY(outputs);
+	if (sample_n > 0) {
+		sample_size = (size_t)sample_n;
+		sample_init();
 	}
 
-	/* verify that some of the fields in our psys are set. */
-	assert(psys->base_url != NULL);
-	assert(psys->url != NULL);
-	assert(psys->status != NULL);
-	assert(psys->ready != NULL);
-	assert(psys->destroy != NULL);
+	writer_t *writers = NULL;
+	size_t nwriters = 0;
+	if (merge) {
+		merge_run(merge_paths, nmerge, merge_key, merge_count,
+			  merge_times);
+	} else if (ninputs != 0) {
+		/* several files are presented one after the other. */
+		for (i = 0; i < ninputs; i++)
+			input_run(inputs[i], input_threads);
+	} else {
+		/* get to final readiness; in particular, get psys set. */
+		read_configs();
+		if (psys == NULL) {
+			psys = pick_system(DEFAULT_SYS);
+			if (psys == NULL)
+				usage("neither " DNSDBQ_SYSTEM
+				      " nor -u were specified,"
+				      " and there is no default.");
+		}
 
-	if ((msg = psys->ready()) != NULL)
-		usage(msg);
-	make_curl();
-	writer_t writer = writer_init(qd.output_limit);
-	query_launcher(&qd, writer);
-	io_engine(0);
-	writer_fini(writer);
-	writer = NULL;
+		/* verify that some of the fields in our psys are set. */
+		assert(psys->base_url != NULL);
+		assert(psys->url != NULL);
+		assert(psys->status != NULL);
+		assert(psys->ready != NULL);
+		assert(psys->destroy != NULL);
+
+		if ((msg = psys->ready()) != NULL)
+			usage(msg);
+		make_curl();
+
+		/* a run of many queries is first checked against the quota. */
+		if (quota_mode != quota_off &&
+		    (batch_run || exhaustive || nshards != 0 || nfanout != 0))
+		{
+			size_t need = batch_run ? sched_count()
+				: ((nfanout != 0) ? nfanout : 1) *
+				  ((nshards != 0) ? (size_t)nshards : 1);
+
+			check_quota(need, exhaustive,
+				    batch_run ? "--batch"
+				    : exhaustive ? "--exhaustive"
+				    : (nshards != 0) ? "--shard"
+				    : "--fanout-rrtypes");
+		}
+
+		if (batch_run) {
+			/* one query per distinct descriptor, cheapest first. */
+			sched_start();
+			while (sched_active())
+				io_engine(0);
+			sched_fini();
+		} else {
+			/* one query, or with --fanout-rrtypes and --shard one
+			 * per rrtype and shard, all running at once and feeding
+			 * the same sinks.
+			 */
+			size_t ntypes = (nfanout != 0) ? nfanout : 1;
+			size_t nparts = (nshards != 0) ? (size_t)nshards : 1;
+
+			nqueries = ntypes * nparts;
+			queries = calloc(nqueries, sizeof *queries);
+			if (queries == NULL)
+				my_panic(true, "calloc");
+			for (i = 0; i < nqueries; i++) {
+				queries[i] = (nshards != 0)
+					? shards[i % nparts] : qd;
+				if (nfanout != 0)
+					queries[i].rrtype =
+						fanout_types[i / nparts];
+			}
+			if (!exhaustive) {
+				nwriters = nqueries;
+				writers = calloc(nwriters, sizeof *writers);
+				if (writers == NULL)
+					my_panic(true, "calloc");
+			}
+			if (exhaustive) {
+				for (i = 0; i < nqueries; i++)
+					exhaustive_start(&queries[i]);
+				/* each limited window adds more while io
+				 * runs.
+				 */
+				while (exhaustive_active())
+					io_engine(0);
+				exhaustive_fini();
+			} else {
+				run_queries(queries, writers, nqueries,
+					    qd.output_limit);
+			}
+		}
+	}
+	if (sample_size > 0)
+		sample_fini();
+	sinks_fini();
+	tuple_first_fini();
+	plugin_unload();
+	budget_report();
+	/* a query not launched has no writer. */
+	if (writers != NULL)
+		for (i = 0; i < nwriters; i++)
+			if (writers[i] != NULL)
+				writer_fini(writers[i]);
+	DESTROY(writers);
+	DESTROY(inputs);
+	DESTROY(queries);
+	shard_free(shards, (size_t)nshards);
+	shards = NULL;
 	unmake_curl();
 
+	if (exclude_suffixes != NULL && !quiet)
+		my_logf("--exclude-file: %zu suffix(es) excluded by the server,"
+			" %zu locally; %ld result(s) dropped locally",
+			exclude_pushed,
+			exclude_suffixes->nsuffixes - exclude_shared,
+			exclude_dropped);
+	hedge_report();
+	aimd_report();
+	endpoints_report();
+	quota_report();
+	if (dedup && !exhaustive && !quiet)
+		my_logf("--dedup: %ld duplicate result(s) dropped",
+			dedup_dropped);
+	/* a truncated run must not pass for a complete one. */
+	if (deadline_ms != 0) {
+		if (!quiet)
+			my_logf("--deadline: %s", deadline_hit
+				? "truncated; the results are partial"
+				: "complete");
+		if (deadline_hit && exit_code == 0)
+			exit_code = DEADLINE_EXIT;
+	}
+
 	/* clean up and go home. */
 	DESTROY(qd.value);
+	DESTROY(qd.exclude);
 	DESTROY(qd.rrtype);
+	suffix_destroy(exclude_suffixes);
+	exclude_suffixes = NULL;
+	regset_destroy(match_set);
+	match_set = NULL;
+	for (i = 0; i < nfanout; i++)
+		DESTROY(fanout_types[i]);
+	DESTROY(fanout_types);
 	my_exit(exit_code);
 }
 
@@ -474,7 +1144,23 @@ help(void) {
 	     "\t\t[--regex REGEX] |\n"
 	     "\t\t[--glob GLOB]\n"
 	     "\t}\n"
-	     "\t[--exclude GLOB|REGEX]\n"
+	     "\t[--exclude GLOB|REGEX] [--exclude-file FILE]\n"
+	     "\t[--match-file FILE]\n"
+	     "\t[--aggregate rrtype|depth|zone[:N]] [--collapse] [--sketch]\n"
+	     "\t[--arrow] [--sample N] [--output FORMAT:FILE ...]\n"
+	     "\t[--presenter-plugin LIB [--plugin-arg ARG]]\n"
+	     "\t[--input FILE ... [--threads N]] [--max-memory SIZE]\n"
+	     "\t[--raw | --count] [--exhaustive] [--deadline DURATION]\n"
+	     "\t[--hedge MS|auto [--hedge-budget PERCENT]] [--timings]\n"
+	     "\t[--quota ignore|off|defer:FILE]\n"
+	     "\t[--fanout-rrtypes[=RRTYPE,...]]\n"
+	     "\t[--shard K [--shard-verify FILE]]\n"
+	     "\t[--plan N | --run-shard DESCRIPTOR | --batch FILE] [--dedup]\n"
+	     "\t[--merge [--merge-key rrname|rrname-rev|rdata]\n"
+	     "\t\t[--merge-count] [--merge-times] FILE ...]\n"
+#ifdef WANT_SQLITE
+	     "\t[--sqlite DB:TABLE [--sqlite-batch N] [--sqlite-upsert]]\n"
+#endif
 #ifdef DETAILS_SUPPORTED
 	     "\t[--mode terse|t|details|d]\n"
 #else
@@ -488,7 +1174,35 @@ help(void) {
 	     "use -d one or more times to ramp up the diagnostic output.\n"
 	     "use -F to get batch mode output.\n"
 	     "use -T to get batch mode output with deduplicated rrtypes.\n"
+	     "use --collapse to get JSON output with one line per name.\n"
+	     "use --sketch to get approximate counts in fixed memory.\n"
+	     "use --sample to output only a uniform random sample of N.\n"
+	     "use --arrow to get Apache Arrow IPC stream output.\n"
+	     "use --output to also write another format to a file.\n"
+	     "use --presenter-plugin to format output with a shared object.\n"
+	     "use --input to present saved -j output instead of querying.\n"
+	     "use --max-memory to cap the memory used for buffers and tables.\n"
+	     "use --raw to write the server's output exactly as sent.\n"
+	     "use --count to get only the number of results.\n"
+	     "use --exhaustive to split limited queries into time windows.\n"
+	     "use --deadline to bound the whole run, keeping partial results.\n"
+	     "use --hedge to retry a slow fetch on a new connection.\n"
+	     "use --timings to report fetch timings and concurrency.\n"
+	     "use --quota to say what to do when the quota would run out.\n"
+	     "use --fanout-rrtypes to run one query per rrtype at once.\n"
+	     "use --shard to split the pattern into K disjoint queries.\n"
+	     "use --plan to print shard descriptors for N time windows.\n"
+	     "use --run-shard to run one shard descriptor from --plan.\n"
+	     "use --batch to run a file of descriptors, cheapest first.\n"
+	     "use --dedup to output each distinct result only once.\n"
+	     "use --merge to merge sorted saved results, collapsing repeats.\n"
+#ifdef WANT_SQLITE
+	     "use --sqlite to insert results into a SQLite table.\n"
+#endif
+	     "use --aggregate to get only per-group counts at the end.\n"
 	     "use --force to issue possibly invalid or non-useful queries.\n"
+	     "use --exclude-file to drop names under any suffix in FILE.\n"
+	     "use --match-file to keep only results matching FILE's regexes.\n"
 	     "use -O # to skip this many results in what is returned.\n"
 	     "use -q for warning reticence.\n"
 	     "use -U to turn off SSL certificate verification.\n"
@@ -604,6 +1318,71 @@ parse_long(const char *in, long *out) {
 	return true;
 }
 
+/* parse_duration -- parse a duration as milliseconds: seconds, which may
+ * have a fraction, or seconds with an "ms" suffix for milliseconds, or
+ * units as for -A and -B (e.g. 1m30s).
+ *
+ * Return true if ok, else return false.
+ */
+static bool
+parse_duration(const char *in, long *ms) {
+	double secs;
+	u_long ttl;
+	char *ep;
+
+	if (!isdigit((unsigned char)*in))
+		return false;
+	errno = 0;
+	secs = strtod(in, &ep);
+	if (errno == 0 && strcmp(ep, "ms") == 0)
+		secs /= 1000.0;
+	else if (errno != 0 || *ep != '\0') {
+		if (ns_parse_ttl(in, &ttl) != 0)
+			return false;
+		secs = (double)ttl;
+	}
+	if (secs < 0.001 || secs > (double)(LONG_MAX / 1000L))
+		return false;
+	*ms = (long)(secs * 1000.0);
+	return true;
+}
+
+/* parse_size -- parse a byte count, with an optional K, M, or G suffix
+ * for powers of 1024.
+ *
+ * Return true if ok, else return false.
+ */
+static bool
+parse_size(const char *in, size_t *out) {
+	unsigned long long result, scale = 1;
+	char *ep;
+
+	if (!isdigit((unsigned char)*in))
+		return false;
+	errno = 0;
+	result = strtoull(in, &ep, 10);
+	if (errno != 0)
+		return false;
+	switch (tolower((unsigned char)*ep)) {
+	case 'k':
+		scale = 1ULL << 10;
+		ep++;
+		break;
+	case 'm':
+		scale = 1ULL << 20;
+		ep++;
+		break;
+	case 'g':
+		scale = 1ULL << 30;
+		ep++;
+		break;
+	}
+	if (*ep != '\0' || result > SIZE_MAX / scale)
+		return false;
+	*out = (size_t)(result * scale);
+	return true;
+}
+
 /* set_timeout -- ingest a setting for curl_timeout
  *
  * exits through usage() if the value is invalid.
@@ -800,8 +1579,8 @@ makepath(qdesc_ct qdp)
  */
 void
 query_launcher(qdesc_ct qdp, writer_t writer) {
-	struct pdns_fence fence = {};
 	query_t query = NULL;
+	endpoint_t endpoint;
 	char *url;
 
 	CREATE(query, sizeof(struct query));
@@ -811,6 +1590,24 @@ query_launcher(qdesc_ct qdp, writer_t writer) {
 	query->writer->query = query;
 	query->command = makepath(qdp);
 
+	endpoint = endpoint_pick(NULL);
+	assert(endpoint != NULL);
+	url = query_url(&query->qd, query->command, endpoint);
+
+	DEBUG(1, true, "url [%s]\n", url);
+	if (curl_timeout != 0)
+		DEBUG(1, true, "curl_timeout is %lu\n", curl_timeout);
+
+	create_fetch(query, url, endpoint);
+}
+
+/* query_url -- form the URL for a query at one of the endpoints.
+ */
+char *
+query_url(qdesc_ct qdp, const char *command, const struct endpoint *endpoint) {
+	struct pdns_fence fence = {};
+	char *url;
+
 	/* figure out from time fencing which job(s) we'll be starting.
 	 *
 	 * the 4-tuple is: first_after, first_before, last_after, last_before
@@ -834,15 +1631,10 @@ query_launcher(qdesc_ct qdp, writer_t writer) {
 		}
 	}
 
-	url = psys->url(query->command, NULL, &query->qd, &fence);
+	url = psys->url(endpoint->base, command, NULL, qdp, &fence);
 	if (url == NULL)
 		my_exit(1);
-
-	DEBUG(1, true, "url [%s]\n", url);
-	if (curl_timeout != 0)
-		DEBUG(1, true, "curl_timeout is %lu\n", curl_timeout);
-
-	create_fetch(query, url);
+	return url;
 }
 
 /* check if its argument is printable ASCII.
@@ -900,3 +1692,282 @@ check_glob_trailing_char(bool warn_only, qdesc_ct qdp) {
 		my_exit(1);
 	}
 }
+
+/* read_exclude_file -- load name suffixes whose results are to be dropped.
+ *
+ * FILE holds one suffix per line, e.g. "example.com." ("*." prefixes and
+ * missing trailing dots are tolerated); blank and '#' lines are skipped.
+ * As many suffixes as fit are pushed into the server-side exclusion, if
+ * --exclude was not also given; the rest go into exclude_suffixes, which
+ * data_blob() checks for each result.
+ */
+static void
+read_exclude_file(const char *path, qdesc_t qdp) {
+	/* with --input there is no query to push anything into, and
+	 * --shard needs the exclusion for itself.
+	 */
+	bool can_push = (qdp->exclude == NULL &&
+			 qdp->search_method != method_none &&
+			 nshards == 0);
+	char *line = NULL;
+	size_t n = 0;
+	int l = 0;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (f == NULL) {
+		my_logf("Cannot read exclude file '%s': %s",
+			path, strerror(errno));
+		my_exit(1);
+	}
+	exclude_suffixes = suffix_new();
+	while (getline(&line, &n, f) > 0) {
+		char *p = line, *name;
+		const char *msg;
+		size_t len;
+
+		l++;
+		p += strspn(p, "\040\t");
+		len = strcspn(p, "\040\t\r\n#");
+		p[len] = '\0';
+		if (strncmp(p, "*.", 2) == 0) {
+			p += 2;
+			len -= 2;
+		}
+		if (len == 0)
+			continue;
+		if (asprintf(&name, "%s%s", p, p[len - 1] == '.' ? "" : ".")
+		    < 0)
+			my_panic(true, "asprintf");
+		if (!force_query &&
+		    (msg = check_printable_ascii(name)) != NULL)
+			usage("%s line #%d: %s", path, l, msg);
+
+		/* glob exclusions cannot cover the suffix name itself,
+		 * so that one is also checked locally, but is counted
+		 * only as pushed.
+		 */
+		if (!can_push || !exclude_pushdown(qdp, name)) {
+			if (!suffix_add(exclude_suffixes, name))
+				usage("%s line #%d: bad name suffix", path, l);
+		} else if (qdp->search_method == method_glob) {
+			if (!suffix_add(exclude_suffixes, name))
+				usage("%s line #%d: bad name suffix", path, l);
+			exclude_shared++;
+		}
+		DESTROY(name);
+	}
+	DESTROY(line);
+	fclose(f);
+
+	if (qdp->exclude != NULL && can_push &&
+	    qdp->search_method == method_regex)
+	{
+		char *regex;
+
+		/* close the alternation that exclude_pushdown() opened. */
+		if (asprintf(&regex, "%s)$", qdp->exclude) < 0)
+			my_panic(true, "asprintf");
+		DESTROY(qdp->exclude);
+		qdp->exclude = regex;
+	}
+	DEBUG(1, true, "exclude file: %zu pushed, %zu local\n",
+	      exclude_pushed, exclude_suffixes->nsuffixes - exclude_shared);
+}
+
+/* exclude_pushdown -- try to add one suffix to the server-side exclusion.
+ *
+ * a glob exclusion can only hold one suffix.  a regex exclusion is an
+ * alternation ^(.*\.)?(a\.com\.|b\.net\.)$ that grows until it would be
+ * longer than MAX_VALUE_LEN; the caller adds the final ")$".
+ * returns true if the suffix was taken.
+ */
+static bool
+exclude_pushdown(qdesc_t qdp, const char *name) {
+	static const char regex_head[] = "^(.*\\.)?(";
+	size_t old_len, add_len;
+	const char *p;
+	char *new, *q;
+
+	if (qdp->search_method == method_glob) {
+		if (qdp->exclude != NULL)
+			return false;
+		if (asprintf(&qdp->exclude, "*.%s", name) < 0)
+			my_panic(true, "asprintf");
+		exclude_pushed++;
+		return true;
+	}
+
+	old_len = (qdp->exclude != NULL)
+		? strlen(qdp->exclude) : sizeof regex_head - 1;
+	add_len = (qdp->exclude != NULL) ? 1 : 0;
+	for (p = name; *p != '\0'; p++)
+		add_len += (strchr(".^$*+?()[]{}|\\", *p) != NULL) ? 2 : 1;
+	if (old_len + add_len + sizeof ")$" - 1 > MAX_VALUE_LEN)
+		return false;
+
+	new = malloc(old_len + add_len + 1);
+	if (new == NULL)
+		my_panic(true, "malloc");
+	memcpy(new, or_else(qdp->exclude, regex_head), old_len);
+	q = new + old_len;
+	if (qdp->exclude != NULL)
+		*q++ = '|';
+	for (p = name; *p != '\0'; p++) {
+		if (strchr(".^$*+?()[]{}|\\", *p) != NULL)
+			*q++ = '\\';
+		*q++ = *p;
+	}
+	*q = '\0';
+	DESTROY(qdp->exclude);
+	qdp->exclude = new;
+	exclude_pushed++;
+	return true;
+}
+
+/* read_match_file -- load the client-side regexes for --match-file.
+ *
+ * each line is "ID<tab>REGEX", or just "REGEX" in which case the line
+ * number is its ID.  blank lines and lines starting with '#' are skipped.
+ */
+static void
+read_match_file(const char *path) {
+	char *line = NULL;
+	size_t n = 0;
+	ssize_t len;
+	int l = 0;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (f == NULL) {
+		my_logf("Cannot read match file '%s': %s",
+			path, strerror(errno));
+		my_exit(1);
+	}
+	match_set = regset_new();
+	while ((len = getline(&line, &n, f)) > 0) {
+		char *regex, *tab, lineno[sizeof "2147483647"];
+		const char *id, *msg;
+
+		l++;
+		while (len > 0 && (line[len - 1] == '\n' ||
+				   line[len - 1] == '\r'))
+			line[--len] = '\0';
+		if (len == 0 || line[0] == '#')
+			continue;
+		if ((tab = strchr(line, '\t')) != NULL) {
+			*tab = '\0';
+			id = line;
+			regex = tab + 1;
+		} else {
+			snprintf(lineno, sizeof lineno, "%d", l);
+			id = lineno;
+			regex = line;
+		}
+		if ((msg = regset_add(match_set, id, regex)) != NULL)
+			usage("%s line #%d: %s", path, l, msg);
+	}
+	DESTROY(line);
+	fclose(f);
+	if (regset_count(match_set) == 0)
+		usage("%s: no patterns found", path);
+	DEBUG(1, true, "match file: %zu patterns\n", regset_count(match_set));
+}
+
+/* parse_fanout -- set the rrtypes for --fanout-rrtypes from a comma
+ * separated list.
+ *
+ * returns NULL on success, else an error message.
+ */
+static const char *
+parse_fanout(const char *list) {
+	const char *p = list;
+
+	/* a later --fanout-rrtypes replaces an earlier one. */
+	while (nfanout > 0)
+		DESTROY(fanout_types[--nfanout]);
+	while (*p != '\0') {
+		size_t len = strcspn(p, ",");
+		size_t j;
+
+		if (len == 0)
+			return "--fanout-rrtypes has an empty rrtype";
+		for (j = 0; j < len; j++)
+			if (!isalnum((unsigned char)p[j]) && p[j] != '-')
+				return "--fanout-rrtypes rrtypes must be"
+					" letters, digits, and hyphens";
+		fanout_types = realloc(fanout_types,
+				       (nfanout + 1) * sizeof *fanout_types);
+		if (fanout_types == NULL)
+			my_panic(true, "realloc");
+		fanout_types[nfanout++] = strndup(p, len);
+		p += len;
+		if (*p == ',' && *++p == '\0')
+			return "--fanout-rrtypes has an empty rrtype";
+	}
+	if (nfanout == 0)
+		return "--fanout-rrtypes needs at least one rrtype";
+	fanout = true;
+	return NULL;
+}
+
+/* check_quota -- learn the quota and say what the planned queries will use
+ * of it; refuse to start a run that would not fit unless --quota says to
+ * go on anyway or to defer what does not fit.
+ */
+static void
+check_quota(size_t need, bool at_least, const char *what) {
+	quota_load();
+	if (quota_fits(need, at_least, what))
+		return;
+	if (quota_mode == quota_ignore) {
+		if (!quiet)
+			my_logf("warning: %s: the quota will run out;"
+				" going on as --quota ignore says", what);
+		quota_waive();
+		return;
+	}
+	if (quota_defer != NULL)
+		return;
+	my_logf("%s: the quota would run out; use --quota defer:FILE"
+		" with --batch to run what fits, or --quota ignore", what);
+	my_exit(1);
+}
+
+/* run_queries -- run one query per writer.  several, from --shard or
+ * --fanout-rrtypes, are started as the concurrency window allows, so
+ * they stay within what the server allows at once.
+ */
+static void
+run_queries(struct qdesc *queries, writer_t *writers, size_t n,
+	    long output_limit)
+{
+	const char *what = (nshards != 0) ? "--shard" : "--fanout-rrtypes";
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		if (n > 1) {
+			/* wait for a free slot. */
+			io_engine((int)aimd_jobs() - 1);
+			if (deadline_left() <= 0 || quota_left() <= 0L)
+				break;
+		}
+		writers[i] = writer_init(output_limit);
+		query_launcher(&queries[i], writers[i]);
+	}
+	io_engine(0);
+
+	if (i == n)
+		return;
+	if (quota_left() <= 0L) {
+		exit_code = 1;
+		if (!quiet)
+			my_logf("%s: %zu query(ies) not run for want of quota",
+				what, n - i);
+	} else {
+		deadline_hit = true;
+		if (!quiet)
+			my_logf("%s: %zu query(ies) not run before --deadline",
+				what, n - i);
+	}
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2014-2020 by Farsight Security, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef DNSDBFLEX_PLUGIN_H_INCLUDED
+#define DNSDBFLEX_PLUGIN_H_INCLUDED 1
+
+/* the ABI between dnsdbflex and presenter plugins loaded with
+ * --presenter-plugin.  this header stands alone so that a plugin needs
+ * nothing else from the dnsdbflex sources, nor jansson or libcurl.
+ *
+ * a plugin is a shared object exporting DNSDBFLEX_PLUGIN_ENTRY, a function
+ * of type dnsdbflex_plugin_entry_t returning a static descriptor whose
+ * abi member must equal the DNSDBFLEX_PLUGIN_ABI the plugin was built
+ * with.  any incompatible change to these structures bumps
+ * DNSDBFLEX_PLUGIN_ABI and with it the entry symbol's name, so an old
+ * plugin is rejected rather than misread.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define DNSDBFLEX_PLUGIN_ABI 1
+#define DNSDBFLEX_PLUGIN_ENTRY "dnsdbflex_plugin_v1"
+
+/* a read-only view of one result, valid only during the present call.
+ * absent string fields are NULL; absent numbers have their has_ flag
+ * false.  json is the result line as the server sent it, not
+ * NUL-terminated.
+ */
+struct dnsdbflex_tuple {
+	size_t		 size;		/* sizeof this struct in the host */
+	const char	*rrname;
+	const char	*rrtype;
+	const char	*rdata;
+	const char	*raw_rdata;
+	bool		 has_count, has_time_first, has_time_last;
+	int64_t		 count;
+	uint64_t	 time_first, time_last;
+	const char	*json;
+	size_t		 jsonlen;
+};
+
+/* where a plugin writes its output.  write returns 0 on success. */
+struct dnsdbflex_output {
+	void		*handle;
+	int		(*write)(void *handle, const void *buf, size_t len);
+};
+
+/* the plugin's descriptor.  each function returns 0 on success; any other
+ * value makes dnsdbflex stop with an error.  init gets the --plugin-arg
+ * string, or NULL, and may set *state for the other calls.  fini must
+ * release the state.
+ */
+struct dnsdbflex_plugin {
+	uint32_t	 abi;
+	const char	*name;
+	int		(*init)(void **state, const char *arg,
+				const struct dnsdbflex_output *);
+	int		(*present)(void *state,
+				   const struct dnsdbflex_tuple *,
+				   const struct dnsdbflex_output *);
+	int		(*fini)(void *state, const struct dnsdbflex_output *);
+};
+
+typedef const struct dnsdbflex_plugin *(*dnsdbflex_plugin_entry_t)(void);
+
+/* every plugin defines this, under the name DNSDBFLEX_PLUGIN_ENTRY. */
+const struct dnsdbflex_plugin *dnsdbflex_plugin_v1(void);
+
+#endif /*DNSDBFLEX_PLUGIN_H_INCLUDED*/
@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2014-2020 by Farsight Security, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* asprintf() does not appear on linux without this */
+#define _GNU_SOURCE
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "defs.h"
+#include "netio.h"
+#include "pdns.h"
+#include "endpoint.h"
+#include "globals.h"
+
+static struct endpoint *endpoints = NULL;
+static size_t nendpoints = 0;
+
+/* endpoints_parse -- set up the endpoints from a server list: base URLs
+ * separated by commas, each optionally followed by ;WEIGHT.  the suffix
+ * is added to each base URL not already containing it.
+ *
+ * returns NULL on success, else an error message.
+ */
+const char *
+endpoints_parse(const char *list, const char *suffix) {
+	const char *p = list;
+
+	endpoints_free();
+	while (*p != '\0') {
+		size_t len = strcspn(p, ","), urllen;
+		const char *semi = memchr(p, ';', len);
+		struct endpoint *ep;
+		long weight = 1;
+		char *url;
+
+		urllen = (semi != NULL) ? (size_t)(semi - p) : len;
+		while (urllen > 0 && isspace((unsigned char)*p)) {
+			p++;
+			len--;
+			urllen--;
+		}
+		while (urllen > 0 && isspace((unsigned char)p[urllen - 1]))
+			urllen--;
+		if (semi != NULL) {
+			char *ep_end;
+
+			weight = strtol(semi + 1, &ep_end, 10);
+			if (ep_end == semi + 1 || weight <= 0 ||
+			    (size_t)(ep_end - p) < len)
+				return "a server weight must be a positive"
+					" integer";
+		}
+		if (urllen == 0)
+			return "a server list has an empty entry";
+		url = strndup(p, urllen);
+		if (strstr(url, suffix) == NULL) {
+			char *full;
+
+			if (asprintf(&full, "%s%s", url, suffix) < 0)
+				my_panic(true, "asprintf");
+			DESTROY(url);
+			url = full;
+		}
+		endpoints = realloc(endpoints,
+				    (nendpoints + 1) * sizeof *endpoints);
+		if (endpoints == NULL)
+			my_panic(true, "realloc");
+		ep = &endpoints[nendpoints++];
+		*ep = (struct endpoint){ .base = url, .weight = weight };
+		DEBUG(1, true, "endpoint %s weight %ld\n", url, weight);
+		p += len;
+		if (*p == ',')
+			p++;
+	}
+	if (nendpoints == 0)
+		return "the server list is empty";
+	return NULL;
+}
+
+/* endpoints_count -- how many endpoints there are.
+ */
+size_t
+endpoints_count(void) {
+	return nendpoints;
+}
+
+/* endpoint_pick -- choose the endpoint for a new fetch: of those not
+ * recently failed, the one with the fewest fetches outstanding for its
+ * weight, other than the one given (which may be NULL).  if all have
+ * failed, the one failed longest ago.
+ *
+ * returns NULL only if there is no endpoint but the one to avoid.
+ */
+endpoint_t
+endpoint_pick(const struct endpoint *avoid) {
+	time_t now = time(NULL);
+	endpoint_t best = NULL, oldest = NULL;
+	size_t i;
+
+	for (i = 0; i < nendpoints; i++) {
+		endpoint_t ep = &endpoints[i];
+
+		if (ep == avoid)
+			continue;
+		if (ep->down_until > now) {
+			if (oldest == NULL ||
+			    ep->down_until < oldest->down_until)
+				oldest = ep;
+			continue;
+		}
+		/* fewest outstanding per unit of weight, cross multiplied. */
+		if (best == NULL ||
+		    ep->outstanding * best->weight <
+		    best->outstanding * ep->weight)
+			best = ep;
+	}
+	return (best != NULL) ? best : oldest;
+}
+
+/* endpoint_start -- count a fetch begun on an endpoint.
+ */
+void
+endpoint_start(endpoint_t ep) {
+	ep->outstanding++;
+	ep->fetches++;
+}
+
+/* endpoint_release -- count a fetch on an endpoint ended.
+ */
+void
+endpoint_release(endpoint_t ep) {
+	ep->outstanding--;
+}
+
+/* endpoint_failed -- avoid an endpoint for a while after a connection
+ * failure or a server error.  a lone endpoint cannot be avoided.
+ */
+void
+endpoint_failed(endpoint_t ep) {
+	time_t now = time(NULL);
+	bool was_up = (ep->down_until <= now);
+
+	ep->failures++;
+	if (nendpoints < 2)
+		return;
+	ep->down_until = now + ENDPOINT_DOWN_SECS;
+	if (was_up && !quiet)
+		my_logf("server %s failed; avoiding it for %d seconds",
+			ep->base, ENDPOINT_DOWN_SECS);
+}
+
+/* endpoints_report -- with several endpoints, say how each was used.
+ */
+void
+endpoints_report(void) {
+	size_t i;
+
+	if (quiet || nendpoints < 2)
+		return;
+	for (i = 0; i < nendpoints; i++)
+		my_logf("server %s: %lu fetch(es), %lu failure(s)",
+			endpoints[i].base, endpoints[i].fetches,
+			endpoints[i].failures);
+}
+
+/* endpoints_free -- release the endpoints.
+ */
+void
+endpoints_free(void) {
+	size_t i;
+
+	for (i = 0; i < nendpoints; i++)
+		DESTROY(endpoints[i].base);
+	DESTROY(endpoints);
+	nendpoints = 0;
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2014-2020 by Farsight Security, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ENDPOINT_H_INCLUDED
+#define ENDPOINT_H_INCLUDED 1
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+/* an endpoint that failed is avoided for this many seconds. */
+#define ENDPOINT_DOWN_SECS 30
+
+/* one of the servers a pDNS system may be reached at. */
+struct endpoint {
+	char		*base;
+	long		 weight;
+	long		 outstanding;
+	time_t		 down_until;
+	unsigned long	 fetches, failures;
+};
+typedef struct endpoint *endpoint_t;
+
+const char *endpoints_parse(const char *, const char *);
+size_t endpoints_count(void);
+endpoint_t endpoint_pick(const struct endpoint *);
+void endpoint_start(endpoint_t);
+void endpoint_release(endpoint_t);
+void endpoint_failed(endpoint_t);
+void endpoints_report(void);
+void endpoints_free(void);
+
+#endif /*ENDPOINT_H_INCLUDED*/
@@ -0,0 +1,357 @@
+/*
+ * Copyright (c) 2014-2020 by Farsight Security, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "defs.h"
+#include "netio.h"
+#include "pdns.h"
+#include "aimd.h"
+#include "time.h"
+#include "quota.h"
+#include "exhaustive.h"
+#include "globals.h"
+
+/* a window to be queried, being queried, or limited and held until the
+ * other pieces of the window it was split from are done.
+ */
+struct window {
+	struct qdesc	qd;
+	size_t		split;		/* that it is a piece of, or NO_SPLIT */
+	writer_t	writer;		/* while it is being queried */
+	int		count;		/* results, once it was limited */
+};
+
+/* a limited window's split: its pieces still being queried, the new
+ * (not deduplicated) results they brought, and whether any was not
+ * limited.  a limited piece is split in turn only if one of the others
+ * narrowed the range or the pieces together brought new results.
+ */
+struct split {
+	size_t		left;
+	long		fresh;
+	bool		eased;
+};
+#define NO_SPLIT ((size_t)-1)
+
+static void push(qdesc_ct, u_long, u_long, size_t);
+static void launch(void);
+static void piece_done(size_t);
+static void split(const struct window *);
+static void incomplete(const struct window *, const char *);
+static void learn(double);
+static void *grow(void *, size_t *, size_t, size_t);
+
+/* windows still to be queried, being queried, and held, as query
+ * descriptors whose strings belong to the caller of exhaustive_start().
+ */
+static struct window *pending = NULL, *running = NULL, *held = NULL;
+static size_t npending = 0, maxpending = 0;
+static size_t nrunning = 0, maxrunning = 0;
+static size_t nheld = 0, maxheld = 0;
+static struct split *splits = NULL;
+static size_t nsplits = 0, maxsplits = 0;
+/* results per second, as learned from the windows queried so far. */
+static double density = 0.0;
+static unsigned long nqueries = 0, nincomplete = 0;
+
+/* exhaustive_start -- query the whole time range of a query descriptor,
+ * splitting any window the server limits until every window succeeds.
+ *
+ * windows overlap-match (like -A/-B without -c), so a result that spans
+ * a split point is returned for both sides; dedup is set, so that
+ * data_blob() drops the second copy.  called once per query, e.g. per
+ * rrtype for --fanout-rrtypes, and the descriptor's strings must outlive
+ * the run.  each query starts with its whole range: what is learned of
+ * the density sizes the pieces of limited windows, not the first one.
+ */
+void
+exhaustive_start(qdesc_ct qdp) {
+	u_long after, before;
+
+	dedup = true;
+	/* main() refused an empty range; only the clock can make one. */
+	if (!exhaustive_range(qdp, &after, &before))
+		return;
+	push(qdp, after, before, NO_SPLIT);
+	launch();
+}
+
+/* exhaustive_range -- the time range split into windows: -A to -B, or
+ * from EXHAUSTIVE_EPOCH and to now where they were not given.
+ *
+ * returns false if the range is empty.
+ */
+bool
+exhaustive_range(qdesc_ct qdp, u_long *after, u_long *before) {
+	*after = (qdp->after != 0) ? qdp->after : EXHAUSTIVE_EPOCH;
+	*before = (qdp->before != 0) ? qdp->before : (u_long)time(NULL);
+	return *after < *before;
+}
+
+/* exhaustive_active -- true while any window is being or is to be queried.
+ */
+bool
+exhaustive_active(void) {
+	return nrunning > 0 || (npending > 0 && deadline_left() > 0 &&
+				quota_left() > 0L);
+}
+
+/* exhaustive_done -- a window's query has ended; hold it to be split if
+ * it was limited, learn from it if it succeeded, then start more windows.
+ *
+ * the fetch has been reaped, so the query and its writer can go.
+ */
+void
+exhaustive_done(query_t query) {
+	struct window w;
+	size_t i;
+
+	for (i = 0; running[i].writer != query->writer; i++)
+		if (i + 1 == nrunning)
+			abort();
+	w = running[i];
+	running[i] = running[--nrunning];
+
+	/* --deadline cut it off; what came is kept, and no more start. */
+	if (query_cut(query)) {
+		writer_fini(query->writer);
+		return;
+	}
+	if (w.split != NO_SPLIT)
+		splits[w.split].fresh += query->writer->count -
+			query->writer->dups;
+	switch (query->saf_cond) {
+	case sc_limited:
+		w.count = query->writer->count;
+		w.writer = NULL;
+		if (w.split == NO_SPLIT) {
+			split(&w);
+		} else {
+			held = grow(held, &maxheld, nheld, sizeof *held);
+			held[nheld++] = w;
+		}
+		break;
+	case sc_succeeded:
+		if (w.split != NO_SPLIT)
+			splits[w.split].eased = true;
+		if (query->writer->count > 0)
+			learn((double)query->writer->count /
+			      (double)(w.qd.before - w.qd.after));
+		break;
+	case sc_init:
+	case sc_begin:
+	case sc_ongoing:
+	case sc_failed:
+	case sc_we_limited:
+	case sc_missing:
+		my_logf("--exhaustive: the window from %s failed: %s",
+			time_str(w.qd.after),
+			or_else(query->saf_msg,
+				or_else(query->message, "no result")));
+		exit_code = 1;
+		break;
+	}
+	writer_fini(query->writer);
+	if (w.split != NO_SPLIT)
+		piece_done(w.split);
+	launch();
+}
+
+/* exhaustive_fini -- report and release.
+ */
+void
+exhaustive_fini(void) {
+	/* limited windows held for pieces --deadline or the quota stopped. */
+	size_t left = npending + nheld;
+
+	if (!quiet)
+		my_logf("--exhaustive: %lu window(s) queried, %zu limited"
+			" window(s) split, %ld duplicate result(s) dropped",
+			nqueries, nsplits, dedup_dropped);
+	if (nincomplete > 0 && !quiet)
+		my_logf("--exhaustive: %lu limited window(s) not split",
+			nincomplete);
+	if (left > 0 && quota_left() <= 0L) {
+		/* the results are incomplete, so the run has failed. */
+		exit_code = 1;
+		if (!quiet)
+			my_logf("--exhaustive: %zu window(s) not queried"
+				" for want of quota", left);
+	} else if (left > 0) {
+		deadline_hit = true;
+		if (!quiet)
+			my_logf("--exhaustive: %zu window(s) not queried"
+				" before --deadline", left);
+	}
+	DESTROY(pending);
+	DESTROY(running);
+	DESTROY(held);
+	DESTROY(splits);
+	npending = maxpending = nrunning = maxrunning = 0;
+	nheld = maxheld = nsplits = maxsplits = 0;
+}
+
+/* push -- add a window to those still to be queried.
+ */
+static void
+push(qdesc_ct qdp, u_long after, u_long before, size_t s) {
+	pending = grow(pending, &maxpending, npending, sizeof *pending);
+	memset(&pending[npending], 0, sizeof pending[npending]);
+	pending[npending].qd = *qdp;
+	pending[npending].qd.after = after;
+	pending[npending].qd.before = before;
+	pending[npending].split = s;
+	npending++;
+}
+
+/* launch -- start pending windows, up to aimd_jobs() at once.
+ *
+ * the most recently split windows go first, so what is learned deep in
+ * one part of the range is soon put to use, and earlier pieces of a split
+ * go before later ones.
+ */
+static void
+launch(void) {
+	while (npending > 0 && nrunning < aimd_jobs() &&
+	       deadline_left() > 0 && quota_left() > 0L)
+	{
+		struct window *w;
+
+		running = grow(running, &maxrunning, nrunning,
+			       sizeof *running);
+		w = &running[nrunning++];
+		*w = pending[--npending];
+		/* without an output limit the server's "limited" is seen. */
+		w->writer = writer_init(-1);
+		query_launcher(&w->qd, w->writer);
+		nqueries++;
+	}
+}
+
+/* piece_done -- one piece of a split is done; once all are, split the
+ * limited ones if any piece succeeded or together they brought new
+ * results.
+ *
+ * if every piece was limited by results seen before, what limits them is
+ * results that outlive every piece, and smaller pieces would only bring
+ * those back again.
+ */
+static void
+piece_done(size_t s) {
+	size_t i = 0;
+
+	if (--splits[s].left > 0)
+		return;
+	while (i < nheld) {
+		struct window w = held[i];
+
+		if (w.split != s) {
+			i++;
+			continue;
+		}
+		held[i] = held[--nheld];
+		if (splits[s].eased || splits[s].fresh > 0)
+			split(&w);
+		else
+			incomplete(&w, "as are the other pieces of the"
+				   " window it was split from, with no new"
+				   " results");
+	}
+}
+
+/* split -- queue the pieces of a window the server limited.
+ *
+ * the count that hit the limit over the window's width is a lower bound
+ * on the window's density; if the windows seen so far say the data is
+ * denser, believe them, and aim for pieces holding about half a limit
+ * each.  that is plain bisection until something has been learned.
+ */
+static void
+split(const struct window *w) {
+	u_long after = w->qd.after, width = w->qd.before - after;
+	double here, dens;
+	u_long n = 2, i;
+	size_t s;
+
+	if (width <= 1) {
+		incomplete(w, "even at one second");
+		return;
+	}
+	if (nqueries + npending >= EXHAUSTIVE_MAX_WINDOWS) {
+		incomplete(w, "past the cap on windows");
+		return;
+	}
+	here = (double)w->count / (double)width;
+	learn(here);
+	dens = (density > here) ? density : here;
+	if (w->count > 0) {
+		double target = (double)w->count / 2.0 / dens;
+		double pieces = (double)width / target;
+
+		if (pieces >= EXHAUSTIVE_FANOUT)
+			n = EXHAUSTIVE_FANOUT;
+		else if (pieces > 2.0)
+			n = (u_long)pieces + 1;
+	}
+	if (n > width)
+		n = width;
+	DEBUG(1, true, "--exhaustive: %lu seconds from %s limited at %d,"
+	      " %lu pieces\n", width, time_str(after), w->count, n);
+	splits = grow(splits, &maxsplits, nsplits, sizeof *splits);
+	s = nsplits++;
+	splits[s].left = n;
+	splits[s].fresh = 0;
+	splits[s].eased = false;
+	/* pushed last to first, so that the first piece pops first. */
+	for (i = n; i-- > 0; )
+		push(&w->qd, after + width * i / n,
+		     after + width * (i + 1) / n, s);
+}
+
+/* incomplete -- report a limited window that will not be split.
+ */
+static void
+incomplete(const struct window *w, const char *why) {
+	my_logf("--exhaustive: the window of %lu seconds from %s is limited"
+		" %s; its results are incomplete",
+		w->qd.before - w->qd.after, time_str(w->qd.after), why);
+	nincomplete++;
+	exit_code = 1;
+}
+
+/* learn -- fold one window's results per second into the running
+ * estimate, weighting recent windows most.
+ */
+static void
+learn(double here) {
+	density = (density == 0.0) ? here : (density + here) / 2.0;
+}
+
+/* grow -- make room in an array of n items for one more.
+ */
+static void *
+grow(void *p, size_t *max, size_t n, size_t size) {
+	if (n < *max)
+		return p;
+	*max = (*max == 0) ? 64 : *max * 2;
+	p = realloc(p, *max * size);
+	if (p == NULL)
+		my_panic(true, "realloc");
+	return p;
+}
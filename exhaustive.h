@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2014-2020 by Farsight Security, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef EXHAUSTIVE_H_INCLUDED
+#define EXHAUSTIVE_H_INCLUDED 1
+
+#include <stdbool.h>
+
+#include "netio.h"
+
+/* with no -A, --exhaustive starts its first window at 2010-01-01. */
+#define EXHAUSTIVE_EPOCH 1262304000UL
+/* a limited window is split into at most this many pieces. */
+#define EXHAUSTIVE_FANOUT 16
+/* no more windows are split once this many have been queried or queued. */
+#define EXHAUSTIVE_MAX_WINDOWS 100000UL
+
+bool exhaustive_range(qdesc_ct, u_long *, u_long *);
+void exhaustive_start(qdesc_ct);
+bool exhaustive_active(void);
+void exhaustive_done(query_t);
+void exhaustive_fini(void);
+
+#endif /*EXHAUSTIVE_H_INCLUDED*/
@@ -33,16 +33,36 @@ EXTERN	const char env_config_file[]	INIT("DNSDBQ_CONFIG_FILE");
 EXTERN	const char env_timeout[]	INIT("DNSDBFLEX_TIMEOUT");
 EXTERN	const char status_noerror[]	INIT("NOERROR");
 EXTERN	const char status_error[]	INIT("ERROR");
+EXTERN	const char status_deadline[]	INIT("DEADLINE");
 EXTERN	pdns_system_ct psys		INIT(NULL);
 EXTERN	int debug_level			INIT(0);
 EXTERN	bool donotverify		INIT(false);
 EXTERN	bool quiet			INIT(false);
 EXTERN	present_e presentation		INIT(pres_json);
-EXTERN	present_t presenter		INIT(NULL);
+EXTERN	struct sink *sinks		INIT(NULL);
+EXTERN	size_t sample_size		INIT(0);
+EXTERN	size_t max_memory		INIT(0);
+EXTERN	bool raw_output			INIT(false);
+EXTERN	bool count_only			INIT(false);
+EXTERN	bool exhaustive			INIT(false);
+EXTERN	bool fanout			INIT(false);
+EXTERN	long nshards			INIT(0);
+EXTERN	bool batch_run			INIT(false);
+EXTERN	long deadline_ms		INIT(0L);
+EXTERN	bool deadline_hit		INIT(false);
+EXTERN	long hedge_ms			INIT(0L);
+EXTERN	long hedge_pct			INIT(10L);
+EXTERN	bool timings			INIT(false);
+EXTERN	const char *quota_defer		INIT(NULL);
 EXTERN	struct timeval startup_time	INIT({});
 EXTERN	int exit_code			INIT(0);
 EXTERN	long curl_ipresolve		INIT(CURL_IPRESOLVE_WHATEVER);
 EXTERN	long curl_timeout		INIT(0L);
+EXTERN	struct suffix *exclude_suffixes	INIT(NULL);
+EXTERN	long exclude_dropped		INIT(0L);
+EXTERN	bool dedup			INIT(false);
+EXTERN	long dedup_dropped		INIT(0L);
+EXTERN	struct regset *match_set	INIT(NULL);
 
 #undef INIT
 #undef EXTERN
@@ -52,6 +72,8 @@ EXTERN	long curl_timeout		INIT(0L);
 
 __attribute__((noreturn)) void my_exit(int);
 __attribute__((noreturn)) void my_panic(bool, const char *);
+void query_launcher(const struct qdesc *, struct writer *);
+char *query_url(const struct qdesc *, const char *, const struct endpoint *);
 
 /* my_logf -- annotate to stderr with program name and current time */
 static inline void
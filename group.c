@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2014-2020 by Farsight Security, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "defs.h"
+#include "pdns.h"
+#include "hash.h"
+#include "budget.h"
+#include "group.h"
+#include "sink.h"
+#include "globals.h"
+
+/* one name (or rdata) whose rrtypes are still being collected. groups are
+ * kept in a queue by first appearance so the oldest is flushed first.
+ */
+struct group {
+	struct group	*next;
+	hashent_t	 ent;
+	json_t		*obj;
+	json_t		*rrtypes;
+	json_t		*raw_rdata;
+	json_t		*matched;
+};
+
+/* roughly what a group's JSON holds on the heap besides its strings. */
+#define GROUP_COST (sizeof(struct group) + 256)
+
+static void group_flush(FILE *);
+static void array_add_unique(json_t *, const char *);
+
+static hash_t pending = NULL;
+static struct group *oldest = NULL, *newest = NULL;
+
+/* present_json_grouped -- collect one tuple into the group for its name.
+ *
+ * with -s rrnames the output is {"rrname":...,"rrtypes":[...]}; with
+ * -s rdata it is {"rdata":...,"rrtypes":[...],"raw_rdata":[...]}.
+ * a group is emitted when GROUP_MAX_PENDING newer groups are waiting
+ * behind it, or at the end.
+ */
+void
+present_json_grouped(pdns_tuple_ct tup,
+		     const char *jsonbuf __attribute__ ((unused)),
+		     size_t jsonlen __attribute__ ((unused)),
+		     sink_t sink)
+{
+	const char *field = (tup->rrname != NULL) ? "rrname" : "rdata";
+	const char *key = or_else(tup->rrname, or_else(tup->rdata, ""));
+	struct group *group;
+	hashent_t ent;
+	bool created;
+	size_t i;
+
+	if (pending == NULL)
+		pending = hash_new();
+
+	/* adjacent rows for one name are the common case. */
+	if (newest != NULL && strcmp(newest->ent->key, key) == 0) {
+		group = newest;
+	} else {
+		ent = hash_put(pending, key, strlen(key), &created);
+		if (created) {
+			group = NULL;
+			budget_need(GROUP_COST, "--collapse");
+			CREATE(group, sizeof *group);
+			group->ent = ent;
+			group->obj = json_object();
+			json_object_set_new(group->obj, field,
+					    json_string(key));
+			group->rrtypes = json_array();
+			json_object_set_new(group->obj, "rrtypes",
+					    group->rrtypes);
+			ent->val.ptr = group;
+			if (newest != NULL)
+				newest->next = group;
+			else
+				oldest = group;
+			newest = group;
+		} else {
+			group = ent->val.ptr;
+		}
+	}
+
+	if (tup->rrtype != NULL)
+		array_add_unique(group->rrtypes, tup->rrtype);
+	if (tup->raw_rdata != NULL) {
+		if (group->raw_rdata == NULL) {
+			group->raw_rdata = json_array();
+			json_object_set_new(group->obj, "raw_rdata",
+					    group->raw_rdata);
+		}
+		array_add_unique(group->raw_rdata, tup->raw_rdata);
+	}
+	if (tup->obj.matched != NULL) {
+		if (group->matched == NULL) {
+			group->matched = json_array();
+			json_object_set_new(group->obj, "matched",
+					    group->matched);
+		}
+		for (i = 0; i < json_array_size(tup->obj.matched); i++)
+			array_add_unique(group->matched,
+				json_string_value(
+					json_array_get(tup->obj.matched, i)));
+	}
+
+	if (pending->count > GROUP_MAX_PENDING)
+		group_flush(sink->out);
+}
+
+/* group_fini -- emit every group still pending.
+ */
+void
+group_fini(sink_t sink) {
+	while (oldest != NULL)
+		group_flush(sink->out);
+	hash_destroy(pending, NULL);
+	pending = NULL;
+}
+
+/* group_flush -- emit and forget the oldest pending group.
+ */
+static void
+group_flush(FILE *out) {
+	struct group *group = oldest;
+
+	json_dumpf(group->obj, out, JSON_INDENT(0) | JSON_COMPACT);
+	putc('\n', out);
+	oldest = group->next;
+	if (oldest == NULL)
+		newest = NULL;
+	json_decref(group->obj);
+	hash_del(pending, group->ent->key, group->ent->keylen, NULL);
+	DESTROY(group);
+	budget_give(GROUP_COST);
+}
+
+/* array_add_unique -- append a string to a JSON array if it is not there.
+ */
+static void
+array_add_unique(json_t *array, const char *str) {
+	size_t i;
+
+	for (i = 0; i < json_array_size(array); i++)
+		if (strcmp(json_string_value(json_array_get(array, i)),
+			   str) == 0)
+			return;
+	json_array_append_new(array, json_string(str));
+}
@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2014-2020 by Farsight Security, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "defs.h"
+#include "pdns.h"
+#include "hash.h"
+#include "budget.h"
+#include "globals.h"
+
+#define HASH_MIN_BUCKETS 64
+
+static void hash_grow(hash_t);
+
+/* hash_bytes -- FNV-1a over a counted string.
+ */
+uint32_t
+hash_bytes(const char *key, size_t len) {
+	uint32_t h = 2166136261U;
+
+	while (len-- > 0) {
+		h ^= (uint8_t)*key++;
+		h *= 16777619U;
+	}
+	return h;
+}
+
+/* hash_new -- create an empty hash table.
+ */
+hash_t
+hash_new(void) {
+	hash_t hash = NULL;
+
+	budget_need(sizeof *hash + HASH_MIN_BUCKETS * sizeof(hashent_t),
+		    "a hash table");
+	CREATE(hash, sizeof *hash);
+	hash->nbuckets = HASH_MIN_BUCKETS;
+	hash->buckets = calloc(hash->nbuckets, sizeof(hashent_t));
+	if (hash->buckets == NULL)
+		my_panic(true, "calloc");
+	return hash;
+}
+
+/* hash_get -- find an entry by key, or return NULL.
+ */
+hashent_t
+hash_get(hash_t hash, const char *key, size_t keylen) {
+	uint32_t h = hash_bytes(key, keylen);
+	hashent_t ent;
+
+	for (ent = hash->buckets[h & (hash->nbuckets - 1)];
+	     ent != NULL;
+	     ent = ent->next)
+		if (ent->hash == h && ent->keylen == keylen &&
+		    memcmp(ent->key, key, keylen) == 0)
+			return ent;
+	return NULL;
+}
+
+/* hash_put -- find an entry by key, creating it (zero valued) if needed.
+ *
+ * if created is not NULL, it is set to whether the entry is new.
+ */
+hashent_t
+hash_put(hash_t hash, const char *key, size_t keylen, bool *created) {
+	hashent_t ent;
+
+	ent = hash_get(hash, key, keylen);
+	if (created != NULL)
+		*created = (ent == NULL);
+	if (ent != NULL)
+		return ent;
+
+	if (hash->count >= hash->nbuckets)
+		hash_grow(hash);
+	budget_need(sizeof *ent + keylen + 1, "a hash table entry");
+	CREATE(ent, sizeof *ent + keylen + 1);
+	ent->hash = hash_bytes(key, keylen);
+	ent->keylen = keylen;
+	memcpy(ent->key, key, keylen);
+	ent->key[keylen] = '\0';
+
+	hashent_t *bucket = &hash->buckets[ent->hash & (hash->nbuckets - 1)];
+	ent->next = *bucket;
+	*bucket = ent;
+	hash->count++;
+	return ent;
+}
+
+/* hash_del -- remove an entry by key; returns true if it was present.
+ */
+bool
+hash_del(hash_t hash, const char *key, size_t keylen,
+	 void (*free_value)(void *))
+{
+	uint32_t h = hash_bytes(key, keylen);
+	hashent_t *pp, ent;
+
+	for (pp = &hash->buckets[h & (hash->nbuckets - 1)];
+	     (ent = *pp) != NULL;
+	     pp = &ent->next)
+		if (ent->hash == h && ent->keylen == keylen &&
+		    memcmp(ent->key, key, keylen) == 0)
+		{
+			*pp = ent->next;
+			if (free_value != NULL)
+				free_value(ent->val.ptr);
+			budget_give(sizeof *ent + ent->keylen + 1);
+			DESTROY(ent);
+			hash->count--;
+			return true;
+		}
+	return false;
+}
+
+/* hash_next -- iterate; pass NULL to get the first entry.
+ *
+ * the table must not be modified during an iteration.
+ */
+hashent_t
+hash_next(hash_t hash, hashent_t ent) {
+	size_t i = 0;
+
+	if (ent != NULL) {
+		if (ent->next != NULL)
+			return ent->next;
+		i = (ent->hash & (hash->nbuckets - 1)) + 1;
+	}
+	for (; i < hash->nbuckets; i++)
+		if (hash->buckets[i] != NULL)
+			return hash->buckets[i];
+	return NULL;
+}
+
+/* hash_destroy -- free a table and its entries, and optionally the values.
+ */
+void
+hash_destroy(hash_t hash, void (*free_value)(void *)) {
+	size_t i;
+
+	if (hash == NULL)
+		return;
+	for (i = 0; i < hash->nbuckets; i++) {
+		hashent_t ent, next;
+
+		for (ent = hash->buckets[i]; ent != NULL; ent = next) {
+			next = ent->next;
+			if (free_value != NULL)
+				free_value(ent->val.ptr);
+			budget_give(sizeof *ent + ent->keylen + 1);
+			DESTROY(ent);
+		}
+	}
+	budget_give(sizeof *hash + hash->nbuckets * sizeof(hashent_t));
+	DESTROY(hash->buckets);
+	DESTROY(hash);
+}
+
+/* hash_grow -- double the bucket count and rehash every entry.
+ */
+static void
+hash_grow(hash_t hash) {
+	size_t nbuckets = hash->nbuckets * 2, i;
+	hashent_t *buckets;
+
+	budget_need(hash->nbuckets * sizeof(hashent_t), "a hash table");
+	buckets = calloc(nbuckets, sizeof(hashent_t));
+	if (buckets == NULL)
+		my_panic(true, "calloc");
+	for (i = 0; i < hash->nbuckets; i++) {
+		hashent_t ent, next;
+
+		for (ent = hash->buckets[i]; ent != NULL; ent = next) {
+			next = ent->next;
+			ent->next = buckets[ent->hash & (nbuckets - 1)];
+			buckets[ent->hash & (nbuckets - 1)] = ent;
+		}
+	}
+	DESTROY(hash->buckets);
+	hash->buckets = buckets;
+	hash->nbuckets = nbuckets;
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2014-2020 by Farsight Security, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HASH_H_INCLUDED
+#define HASH_H_INCLUDED 1
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* one entry in a hash table.  the key is a counted string copied into the
+ * entry itself; the value is owned by the caller.
+ */
+struct hashent {
+	struct hashent	*next;
+	uint32_t	 hash;
+	size_t		 keylen;
+	union {
+		void	*ptr;
+		long	 num;
+	} val;
+	char		 key[];
+};
+typedef struct hashent *hashent_t;
+
+struct hash {
+	struct hashent	**buckets;
+	size_t		 nbuckets;
+	size_t		 count;
+};
+typedef struct hash *hash_t;
+
+uint32_t hash_bytes(const char *, size_t);
+hash_t hash_new(void);
+hashent_t hash_get(hash_t, const char *, size_t);
+hashent_t hash_put(hash_t, const char *, size_t, bool *);
+bool hash_del(hash_t, const char *, size_t, void (*)(void *));
+hashent_t hash_next(hash_t, hashent_t);
+void hash_destroy(hash_t, void (*)(void *));
+
+#endif /*HASH_H_INCLUDED*/
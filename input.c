@@ -0,0 +1,286 @@
+/*
+ * Copyright (c) 2014-2020 by Farsight Security, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "defs.h"
+#include "pdns.h"
+#include "budget.h"
+#include "input.h"
+#include "sample.h"
+#include "sink.h"
+#include "globals.h"
+
+/* one chunk of the input, and what parsing it produced for each sink. */
+struct chunk {
+	const char	*path, *base;
+	const char	*start, *end;
+	size_t		 nsinks;
+	struct sink	*shadows;
+	char		**bufs;
+	size_t		*lens;
+	long		 dropped;
+};
+
+static bool input_parallel_ok(void);
+static void input_sequential(const char *, const char *, const char *);
+static void input_parallel(const char *, const char *, const char *, long);
+static void *chunk_run(void *);
+static const char *chunk_end(const char *, const char *);
+
+/* input_run -- present the results saved in a file, instead of querying.
+ *
+ * the file holds one JSON result per line, either as -j printed it or as
+ * the server sent it.  if every sink renders each result on its own, the
+ * file is cut into chunks parsed by up to nthreads threads, and each
+ * chunk's output is written in file order.
+ */
+void
+input_run(const char *path, long nthreads) {
+	struct stat sb;
+	const char *base;
+	void *map;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &sb) < 0) {
+		my_logf("--input: %s: %s", path, strerror(errno));
+		my_exit(1);
+	}
+	if (sb.st_size == 0) {
+		close(fd);
+		return;
+	}
+	map = mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED) {
+		my_logf("--input: %s: mmap: %s", path, strerror(errno));
+		my_exit(1);
+	}
+	close(fd);
+	(void) madvise(map, (size_t)sb.st_size, MADV_SEQUENTIAL);
+	base = map;
+
+	if (nthreads > 1 && (size_t)sb.st_size > INPUT_CHUNK &&
+	    input_parallel_ok())
+		input_parallel(path, base, base + sb.st_size, nthreads);
+	else
+		input_sequential(path, base, base + sb.st_size);
+	munmap(map, (size_t)sb.st_size);
+}
+
+/* input_parallel_ok -- true if chunks may be parsed in parallel.
+ *
+ * that needs presenters which keep no state between results, and filters
+ * that are safe to share between threads.
+ */
+static bool
+input_parallel_ok(void) {
+	sink_t sink;
+
+	if (match_set != NULL || sample_size > 0 || dedup)
+		return false;
+	for (sink = sinks; sink != NULL; sink = sink->next)
+		if (sink->format != pres_json && sink->format != pres_batch)
+			return false;
+	return true;
+}
+
+/* input_sequential -- parse and present every result, in this thread.
+ */
+static void
+input_sequential(const char *path, const char *base, const char *end) {
+	struct chunk chunk = {
+		.path = path, .base = base,
+		.start = base, .end = end,
+	};
+
+	chunk_run(&chunk);
+	exclude_dropped += chunk.dropped;
+}
+
+/* input_parallel -- parse chunks in waves of up to nthreads threads, each
+ * rendering into memory, then write each chunk's output in file order.
+ */
+static void
+input_parallel(const char *path, const char *base, const char *end,
+	       long nthreads)
+{
+	struct chunk *chunks = NULL;
+	pthread_t *threads = NULL;
+	size_t nsinks = 0, nchunks, i, j;
+	const char *next = base;
+	sink_t sink;
+
+	for (sink = sinks; sink != NULL; sink = sink->next)
+		nsinks++;
+	nchunks = (size_t)nthreads;
+	chunks = calloc(nchunks, sizeof *chunks);
+	threads = calloc(nchunks, sizeof *threads);
+	if (chunks == NULL || threads == NULL)
+		my_panic(true, "calloc");
+	for (i = 0; i < nchunks; i++) {
+		chunks[i].path = path;
+		chunks[i].base = base;
+		chunks[i].nsinks = nsinks;
+		chunks[i].shadows = calloc(nsinks, sizeof(struct sink));
+		chunks[i].bufs = calloc(nsinks, sizeof(char *));
+		chunks[i].lens = calloc(nsinks, sizeof(size_t));
+		if (chunks[i].shadows == NULL || chunks[i].bufs == NULL ||
+		    chunks[i].lens == NULL)
+			my_panic(true, "calloc");
+	}
+
+	/* jansson seeds its hash function on first use, which is racy. */
+	json_object_seed(0);
+
+	while (next < end) {
+		size_t nwave = 0;
+
+		for (i = 0; i < nchunks && next < end; i++) {
+			struct chunk *chunk = &chunks[i];
+
+			chunk->start = next;
+			chunk->end = chunk_end(next, end);
+			next = chunk->end;
+			chunk->dropped = 0;
+			for (j = 0, sink = sinks; sink != NULL;
+			     j++, sink = sink->next)
+			{
+				chunk->shadows[j] = *sink;
+				chunk->shadows[j].next = (sink->next == NULL)
+					? NULL : &chunk->shadows[j + 1];
+				chunk->shadows[j].out =
+					open_memstream(&chunk->bufs[j],
+						       &chunk->lens[j]);
+				if (chunk->shadows[j].out == NULL)
+					my_panic(true, "open_memstream");
+			}
+			if (pthread_create(&threads[i], NULL,
+					   chunk_run, chunk) != 0)
+				my_panic(false, "pthread_create");
+			nwave++;
+		}
+		/* the whole wave's output is held in memory at once. */
+		for (i = 0; i < nwave; i++) {
+			struct chunk *chunk = &chunks[i];
+
+			if (pthread_join(threads[i], NULL) != 0)
+				my_panic(false, "pthread_join");
+			exclude_dropped += chunk->dropped;
+			for (j = 0; j < nsinks; j++) {
+				fclose(chunk->shadows[j].out);
+				budget_need(chunk->lens[j], "--input output");
+			}
+		}
+		for (i = 0; i < nwave; i++) {
+			struct chunk *chunk = &chunks[i];
+
+			for (j = 0, sink = sinks; sink != NULL;
+			     j++, sink = sink->next)
+			{
+				fwrite(chunk->bufs[j], 1, chunk->lens[j],
+				       sink->out);
+				budget_give(chunk->lens[j]);
+				DESTROY(chunk->bufs[j]);
+			}
+		}
+	}
+
+	for (i = 0; i < nchunks; i++) {
+		DESTROY(chunks[i].shadows);
+		DESTROY(chunks[i].bufs);
+		DESTROY(chunks[i].lens);
+	}
+	DESTROY(chunks);
+	DESTROY(threads);
+}
+
+/* chunk_run -- parse one chunk's lines and present each result, to the
+ * chunk's own sinks if it has them, else to the real ones.
+ */
+static void *
+chunk_run(void *arg) {
+	struct chunk *chunk = arg;
+	const char *line, *nl;
+
+	for (line = chunk->start; line < chunk->end; line = nl + 1) {
+		struct pdns_tuple tup;
+		const char *msg;
+		size_t len;
+
+		nl = memchr(line, '\n', (size_t)(chunk->end - line));
+		if (nl == NULL)
+			nl = chunk->end;
+		len = (size_t)(nl - line);
+		if (len > 0 && line[len - 1] == '\r')
+			len--;
+		if (len == 0)
+			continue;
+
+		msg = tuple_make_saved(&tup, line, len);
+		if (msg != NULL) {
+			my_logf("--input: %s: offset %zu: %s", chunk->path,
+				(size_t)(line - chunk->base), msg);
+			continue;
+		}
+		/* skip SAF conditions and keepalives. */
+		if (tup.obj.saf_obj == NULL) {
+			tuple_unmake(&tup);
+			continue;
+		}
+		if (tuple_excluded(&tup)) {
+			chunk->dropped++;
+		} else if (chunk->shadows != NULL) {
+			sink_t sink;
+
+			for (sink = chunk->shadows; sink != NULL;
+			     sink = sink->next)
+				(*sink->present)(&tup, line, len, sink);
+		} else if (tuple_matched(&tup) &&
+			   (!dedup || tuple_first(&tup))) {
+			if (sample_size > 0)
+				present_sample(&tup, line, len);
+			else
+				sinks_present(&tup, line, len);
+		}
+		tuple_unmake(&tup);
+	}
+	return NULL;
+}
+
+/* chunk_end -- find where a chunk starting here should end: just after the
+ * first newline at least INPUT_CHUNK bytes on, or at the end of the input.
+ */
+static const char *
+chunk_end(const char *start, const char *end) {
+	const char *nl;
+
+	if ((size_t)(end - start) <= INPUT_CHUNK)
+		return end;
+	nl = memchr(start + INPUT_CHUNK, '\n',
+		    (size_t)(end - start) - INPUT_CHUNK);
+	return (nl == NULL) ? end : nl + 1;
+}
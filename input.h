@@ -0,0 +1,25 @@
+/*
+ * Copyright (c) 2014-2020 by Farsight Security, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INPUT_H_INCLUDED
+#define INPUT_H_INCLUDED 1
+
+/* input is parsed in chunks of about this many bytes, cut at newlines. */
+#define INPUT_CHUNK (4*1024*1024)
+
+void input_run(const char *, long);
+
+#endif /*INPUT_H_INCLUDED*/
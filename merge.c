@@ -0,0 +1,475 @@
+/*
+ * Copyright (c) 2014-2020 by Farsight Security, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "defs.h"
+#include "pdns.h"
+#include "budget.h"
+#include "merge.h"
+#include "sample.h"
+#include "sink.h"
+#include "globals.h"
+
+/* one input file, positioned at its next result. */
+struct cursor {
+	const char	*path, *base, *pos, *end;
+	void		*map;
+	size_t		 maplen;
+	/* the current result: its line, parsed, and its sort key. */
+	const char	*line;
+	size_t		 len;
+	struct pdns_tuple tup;
+	char		*key, *prev;
+	size_t		 keysize, prevsize;
+	bool		 started;	/* its first line has been seen */
+};
+
+/* one result of the group sharing the smallest key. */
+struct member {
+	struct pdns_tuple tup;
+	const char	*line;
+	size_t		 len;
+	char		*text;
+	bool		 dup;
+};
+
+static bool cursor_next(struct cursor *, merge_key_e);
+static void make_key(struct cursor *, merge_key_e);
+static bool cursor_less(const struct cursor *, const struct cursor *);
+static void heap_down(struct cursor **, size_t, size_t);
+static void heap_up(struct cursor **, size_t);
+static long group_present(struct member *, size_t, bool, bool);
+static bool same_result(pdns_tuple_ct, pdns_tuple_ct);
+static void combine(struct member *, pdns_tuple_ct, bool, bool);
+static void present(pdns_tuple_t, const char *, size_t);
+
+/* merge_key_parse -- parse a --merge-key argument.
+ *
+ * returns NULL on success, else an error message.
+ */
+const char *
+merge_key_parse(const char *arg, merge_key_e *key) {
+	if (strcmp(arg, "rrname") == 0)
+		*key = merge_rrname;
+	else if (strcmp(arg, "rrname-rev") == 0)
+		*key = merge_rrname_rev;
+	else if (strcmp(arg, "rdata") == 0)
+		*key = merge_rdata;
+	else
+		return "--merge-key must be rrname, rrname-rev, or rdata";
+	return NULL;
+}
+
+/* merge_run -- present the results of several files, each sorted by the
+ * key, as one sorted stream with duplicates collapsed.
+ *
+ * the files are mapped, and a heap of one cursor per file gives the
+ * smallest key next; all results with that key, from every file, form a
+ * group in which a result seen again is dropped, optionally after adding
+ * its count to the first's or widening the first's time span.  memory is
+ * one cursor per file plus the largest group.
+ */
+void
+merge_run(char * const *paths, size_t npaths, merge_key_e key,
+	  bool sum_count, bool span_times)
+{
+	struct cursor *cursors, **heap;
+	struct member *group = NULL;
+	size_t ngroup = 0, groupsize = 0, nheap = 0, i;
+	long collapsed = 0;
+
+	budget_need(npaths * (sizeof *cursors + sizeof *heap), "--merge");
+	cursors = calloc(npaths, sizeof *cursors);
+	heap = calloc(npaths, sizeof *heap);
+	if (cursors == NULL || heap == NULL)
+		my_panic(true, "calloc");
+	for (i = 0; i < npaths; i++) {
+		struct cursor *cur = &cursors[i];
+		struct stat sb;
+		void *map;
+		int fd;
+
+		cur->path = paths[i];
+		fd = open(cur->path, O_RDONLY);
+		if (fd < 0 || fstat(fd, &sb) < 0) {
+			my_logf("--merge: %s: %s", cur->path,
+				strerror(errno));
+			my_exit(1);
+		}
+		if (sb.st_size != 0) {
+			map = mmap(NULL, (size_t)sb.st_size, PROT_READ,
+				   MAP_PRIVATE, fd, 0);
+			if (map == MAP_FAILED) {
+				my_logf("--merge: %s: mmap: %s", cur->path,
+					strerror(errno));
+				my_exit(1);
+			}
+			(void) madvise(map, (size_t)sb.st_size,
+				       MADV_SEQUENTIAL);
+			cur->map = map;
+			cur->base = cur->pos = map;
+			cur->maplen = (size_t)sb.st_size;
+			cur->end = cur->base + cur->maplen;
+		}
+		close(fd);
+		if (cursor_next(cur, key)) {
+			heap[nheap] = cur;
+			heap_up(heap, nheap++);
+		}
+	}
+
+	while (nheap > 0) {
+		char *gkey = strdup(heap[0]->key);
+
+		/* take every result with the smallest key, file by file. */
+		ngroup = 0;
+		while (nheap > 0 && strcmp(heap[0]->key, gkey) == 0) {
+			struct cursor *cur = heap[0];
+
+			do {
+				if (ngroup == groupsize) {
+					size_t want = groupsize == 0 ? 16
+						: groupsize * 2;
+
+					budget_need((want - groupsize) *
+						    sizeof *group, "--merge");
+					group = realloc(group,
+							want * sizeof *group);
+					if (group == NULL)
+						my_panic(true, "realloc");
+					groupsize = want;
+				}
+				group[ngroup++] = (struct member){
+					.tup = cur->tup, .line = cur->line,
+					.len = cur->len, .text = NULL,
+					.dup = false
+				};
+				memset(&cur->tup, 0, sizeof cur->tup);
+			} while (cursor_next(cur, key) &&
+				 strcmp(cur->key, gkey) == 0);
+			if (cur->line == NULL) {
+				/* exhausted; the last leaf takes its place. */
+				heap[0] = heap[--nheap];
+			}
+			heap_down(heap, nheap, 0);
+		}
+		collapsed += group_present(group, ngroup, sum_count,
+					   span_times);
+		DESTROY(gkey);
+	}
+
+	for (i = 0; i < npaths; i++) {
+		if (cursors[i].map != NULL)
+			munmap(cursors[i].map, cursors[i].maplen);
+		DESTROY(cursors[i].key);
+		DESTROY(cursors[i].prev);
+	}
+	budget_give(npaths * (sizeof *cursors + sizeof *heap) +
+		    groupsize * sizeof *group);
+	DESTROY(cursors);
+	DESTROY(heap);
+	DESTROY(group);
+	if (!quiet)
+		my_logf("--merge: %zu file(s), %ld duplicate result(s)"
+			" collapsed", npaths, collapsed);
+}
+
+/* cursor_next -- move a cursor to its next result and make its key.
+ *
+ * SAF conditions and keepalives are skipped, and bad lines logged and
+ * skipped, as --input does.  returns false, with line
+ * set to NULL, at the end of the file.  a key smaller than the last one
+ * means the file is not sorted, which is fatal, and so is a first line
+ * that is not JSON: every line of, say, a batch file would be bad.
+ */
+static bool
+cursor_next(struct cursor *cur, merge_key_e key) {
+	while (cur->pos != NULL && cur->pos < cur->end) {
+		const char *line = cur->pos, *nl, *msg;
+		size_t len;
+
+		nl = memchr(line, '\n', (size_t)(cur->end - line));
+		if (nl == NULL)
+			nl = cur->end;
+		cur->pos = nl + 1;
+		len = (size_t)(nl - line);
+		if (len > 0 && line[len - 1] == '\r')
+			len--;
+		if (len == 0)
+			continue;
+		if (!cur->started && line[0] != '{') {
+			my_logf("--merge: %s: not JSON results (a batch file?)",
+				cur->path);
+			my_exit(1);
+		}
+		cur->started = true;
+		msg = tuple_make_saved(&cur->tup, line, len);
+		if (msg == NULL && cur->tup.obj.saf_obj == NULL) {
+			tuple_unmake(&cur->tup);
+			continue;
+		}
+		if (msg == NULL &&
+		    (key == merge_rdata ? cur->tup.rdata : cur->tup.rrname)
+		    == NULL)
+		{
+			tuple_unmake(&cur->tup);
+			msg = (key == merge_rdata) ? "result has no rdata"
+				: "result has no rrname";
+		}
+		if (msg != NULL) {
+			my_logf("--merge: %s: offset %zu: %s", cur->path,
+				(size_t)(line - cur->base), msg);
+			continue;
+		}
+		cur->line = line;
+		cur->len = len;
+		make_key(cur, key);
+		return true;
+	}
+	cur->line = NULL;
+	return false;
+}
+
+/* make_key -- form a cursor's sort key from its current result, and check
+ * that it does not go backward.
+ *
+ * for rrname-rev the labels are reversed, so www.example.com. sorts as
+ * com.example.www; keys are compared as bytes.
+ */
+static void
+make_key(struct cursor *cur, merge_key_e key) {
+	const char *name = (key == merge_rdata) ? cur->tup.rdata
+		: cur->tup.rrname;
+	size_t len = strlen(name), size;
+	char *tmp;
+
+	/* the old key becomes prev, and prev's buffer is reused. */
+	tmp = cur->prev;
+	cur->prev = cur->key;
+	cur->key = tmp;
+	size = cur->prevsize;
+	cur->prevsize = cur->keysize;
+	cur->keysize = size;
+	if (len + 1 > cur->keysize) {
+		cur->keysize = len + 1;
+		cur->key = realloc(cur->key, cur->keysize);
+		if (cur->key == NULL)
+			my_panic(true, "realloc");
+	}
+	if (key == merge_rrname_rev) {
+		const char *end = name + len;
+		char *p = cur->key;
+
+		/* copy labels last to first, ignoring the root's dot. */
+		if (end > name && end[-1] == '.')
+			end--;
+		while (end > name) {
+			const char *dot = end;
+
+			while (dot > name && dot[-1] != '.')
+				dot--;
+			if (p != cur->key)
+				*p++ = '.';
+			memcpy(p, dot, (size_t)(end - dot));
+			p += end - dot;
+			end = (dot > name) ? dot - 1 : name;
+		}
+		*p = '\0';
+	} else {
+		memcpy(cur->key, name, len + 1);
+	}
+	if (cur->prev != NULL && strcmp(cur->key, cur->prev) < 0) {
+		my_logf("--merge: %s: offset %zu: not sorted by %s",
+			cur->path, (size_t)(cur->line - cur->base),
+			key == merge_rdata ? "rdata" :
+			key == merge_rrname ? "rrname" : "reversed rrname");
+		my_exit(1);
+	}
+}
+
+/* cursor_less -- heap order: by key, then by file, so that results with
+ * equal keys come out in the order the files were given.
+ */
+static bool
+cursor_less(const struct cursor *a, const struct cursor *b) {
+	int cmp = strcmp(a->key, b->key);
+
+	return cmp < 0 || (cmp == 0 && a < b);
+}
+
+/* heap_down -- restore the heap below position i.
+ */
+static void
+heap_down(struct cursor **heap, size_t n, size_t i) {
+	for (;;) {
+		size_t l = 2 * i + 1, r = l + 1, min = i;
+		struct cursor *tmp;
+
+		if (l < n && cursor_less(heap[l], heap[min]))
+			min = l;
+		if (r < n && cursor_less(heap[r], heap[min]))
+			min = r;
+		if (min == i)
+			return;
+		tmp = heap[i];
+		heap[i] = heap[min];
+		heap[min] = tmp;
+		i = min;
+	}
+}
+
+/* heap_up -- restore the heap above position i.
+ */
+static void
+heap_up(struct cursor **heap, size_t i) {
+	while (i > 0) {
+		size_t parent = (i - 1) / 2;
+		struct cursor *tmp;
+
+		if (!cursor_less(heap[i], heap[parent]))
+			return;
+		tmp = heap[i];
+		heap[i] = heap[parent];
+		heap[parent] = tmp;
+		i = parent;
+	}
+}
+
+/* group_present -- present each distinct result of a group once, folding
+ * the counts or time spans of its duplicates into it if asked.
+ *
+ * returns the number of duplicates.
+ */
+static long
+group_present(struct member *group, size_t n, bool sum_count,
+	      bool span_times)
+{
+	size_t i, j;
+	long dups = 0;
+
+	for (i = 0; i < n; i++) {
+		if (group[i].dup)
+			continue;
+		for (j = i + 1; j < n; j++)
+			if (!group[j].dup &&
+			    same_result(&group[i].tup, &group[j].tup))
+			{
+				group[j].dup = true;
+				dups++;
+				if (sum_count || span_times)
+					combine(&group[i], &group[j].tup,
+						sum_count, span_times);
+			}
+		present(&group[i].tup, group[i].line, group[i].len);
+	}
+	for (i = 0; i < n; i++) {
+		tuple_unmake(&group[i].tup);
+		DESTROY(group[i].text);
+	}
+	return dups;
+}
+
+/* same_result -- true if two results are the same one, as tuple_first()
+ * would have it.
+ */
+static bool
+same_result(pdns_tuple_ct a, pdns_tuple_ct b) {
+	return strcmp(or_else(a->rrname, ""), or_else(b->rrname, "")) == 0 &&
+		strcmp(or_else(a->rdata, ""), or_else(b->rdata, "")) == 0 &&
+		strcmp(or_else(a->rrtype, ""), or_else(b->rrtype, "")) == 0 &&
+		strcmp(or_else(a->raw_rdata, ""),
+		       or_else(b->raw_rdata, "")) == 0;
+}
+
+/* combine -- fold a duplicate's count and time span into a result.
+ *
+ * the result's JSON is changed, so its line is no longer what is
+ * presented; the tuple is re-made from the changed JSON to keep its
+ * fields and text in step.  the new text is saved -j output, without
+ * the SAF wrapper.
+ */
+static void
+combine(struct member *m, pdns_tuple_ct dup, bool sum_count,
+	bool span_times)
+{
+	json_t *obj = json_object_get(m->tup.obj.main, "obj");
+	bool changed = false;
+	char *text;
+
+	/* saved -j output has no SAF wrapper. */
+	if (obj == NULL)
+		obj = m->tup.obj.main;
+	if (sum_count && m->tup.obj.count != NULL &&
+	    dup->obj.count != NULL)
+	{
+		json_object_set_new(obj, "count",
+				    json_integer(m->tup.count + dup->count));
+		changed = true;
+	}
+	if (span_times && dup->obj.time_first != NULL &&
+	    (m->tup.obj.time_first == NULL ||
+	     dup->time_first < m->tup.time_first))
+	{
+		json_object_set_new(obj, "time_first",
+				    json_integer((json_int_t)dup->time_first));
+		changed = true;
+	}
+	if (span_times && dup->obj.time_last != NULL &&
+	    (m->tup.obj.time_last == NULL ||
+	     dup->time_last > m->tup.time_last))
+	{
+		json_object_set_new(obj, "time_last",
+				    json_integer((json_int_t)dup->time_last));
+		changed = true;
+	}
+	if (!changed)
+		return;
+	text = json_dumps(obj, JSON_COMPACT);
+	if (text == NULL)
+		my_panic(false, "json_dumps");
+	tuple_unmake(&m->tup);
+	if (tuple_make_saved(&m->tup, text, strlen(text)) != NULL)
+		my_panic(false, "--merge: cannot re-parse a combined result");
+	DESTROY(m->text);
+	m->text = text;
+	m->line = text;
+	m->len = strlen(text);
+}
+
+/* present -- pass one merged result to the filters and sinks, as --input
+ * does.
+ */
+static void
+present(pdns_tuple_t tup, const char *line, size_t len) {
+	if (tuple_excluded(tup)) {
+		exclude_dropped++;
+		return;
+	}
+	if (!tuple_matched(tup))
+		return;
+	if (sample_size > 0)
+		present_sample(tup, line, len);
+	else
+		sinks_present(tup, line, len);
+}
@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2014-2020 by Farsight Security, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MERGE_H_INCLUDED
+#define MERGE_H_INCLUDED 1
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* what --merge inputs are sorted by. */
+typedef enum {
+	merge_rrname = 0, merge_rrname_rev, merge_rdata
+} merge_key_e;
+
+const char *merge_key_parse(const char *, merge_key_e *);
+void merge_run(char * const *, size_t, merge_key_e, bool, bool);
+
+#endif /*MERGE_H_INCLUDED*/
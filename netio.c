@@ -24,24 +24,69 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
 #include <signal.h>
+#include <stdint.h>
 #include <string.h>
 #include <unistd.h>
 
 #include "defs.h"
 #include "netio.h"
 #include "pdns.h"
+#include "aimd.h"
+#include "budget.h"
+#include "endpoint.h"
+#include "exhaustive.h"
+#include "quota.h"
+#include "sched.h"
 #include "globals.h"
 
-static void io_drain(void);
+/* --hedge auto hedges a fetch slower to answer than this percentile of
+ * the last HEDGE_SAMPLES fetches, or, until there are HEDGE_MIN_SAMPLES,
+ * one taking over HEDGE_DEFAULT_MS.
+ */
+#define HEDGE_SAMPLES 64
+#define HEDGE_MIN_SAMPLES 8
+#define HEDGE_PERCENTILE 95
+#define HEDGE_DEFAULT_MS 1000L
+
+static bool io_drain(void);
+static fetch_t fetch_new(query_t, char *, endpoint_t, bool);
+static void fetch_answered(fetch_t);
+static bool failover_wanted(const struct fetch *, CURLcode);
+static bool failover(fetch_t);
+static long fetch_rows(const struct fetch *);
+static bool retry_later(fetch_t);
+static void retry_check(void);
+static void retry_unlink(query_t);
+static void hedge_check(void);
+static void hedge_reap(void);
+static long hedge_threshold(void);
+static int long_cmp(const void *, const void *);
 static void fetch_reap(fetch_t);
 static void fetch_done(fetch_t);
 static void fetch_unlink(fetch_t);
 static void query_done(query_t);
+static size_t raw_writer(fetch_t, const char *, size_t);
+static size_t writer_block(fetch_t, char *, size_t);
+static bool deblock(fetch_t);
+static int raw_sniff(query_t, const char *, size_t);
+static bool raw_stop(fetch_t);
+static void raw_put(const char *, size_t);
+static void count_lines(fetch_t, const char *, size_t);
+static size_t count_newlines(const char *, size_t);
+static const char *saf_cond_name(saf_cond_e);
 
 static writer_t writers = NULL;
 static CURLM *multi = NULL;
 static bool curl_cleanup_needed = false;
+/* queries pushed back, waiting to try again. */
+static query_t waiting = NULL;
+/* every fetch in progress, and what --hedge has learned from them. */
+static fetch_t fetches = NULL;
+static long ttfb[HEDGE_SAMPLES];
+static size_t nttfb = 0;
+static unsigned long nfetches = 0, nhedges = 0, nhedge_wins = 0;
 
 const char saf_begin[] = "begin";
 const char saf_ongoing[] = "ongoing";
@@ -80,10 +125,19 @@ unmake_curl(void) {
 	}
 }
 
-/* fetch -- given a url, tell libcurl to go fetch it.
+/* fetch -- given a url at an endpoint, tell libcurl to go fetch it.
  */
 void
-create_fetch(query_t query, char *url) {
+create_fetch(query_t query, char *url, endpoint_t endpoint) {
+	query->fetch = fetch_new(query, url, endpoint, false);
+	nfetches++;
+}
+
+/* fetch_new -- start one fetch of a url at an endpoint for a query,
+ * optionally on a connection of its own.
+ */
+static fetch_t
+fetch_new(query_t query, char *url, endpoint_t endpoint, bool fresh) {
 	fetch_t fetch = NULL;
 	CURLMcode res;
 
@@ -100,6 +154,8 @@ create_fetch(query_t query, char *url) {
 	}
 	fetch->url = url;
 	url = NULL;
+	fetch->endpoint = endpoint;
+	endpoint_start(endpoint);
 	curl_easy_setopt(fetch->easy, CURLOPT_URL, fetch->url);
 	if (donotverify) {
 		curl_easy_setopt(fetch->easy, CURLOPT_SSL_VERIFYPEER, 0L);
@@ -117,6 +173,20 @@ create_fetch(query_t query, char *url) {
 		curl_easy_setopt(fetch->easy,
 				 CURLOPT_TIMEOUT, curl_timeout);
 	}
+	/* no fetch may outlive --deadline, whenever it starts. */
+	if (deadline_ms != 0L) {
+		long left = deadline_left();
+
+		if (left < 1L)
+			left = 1L;
+		if (curl_timeout == 0L || left < curl_timeout * 1000L) {
+			curl_easy_setopt(fetch->easy,
+					 CURLOPT_CONNECTTIMEOUT_MS, left);
+			curl_easy_setopt(fetch->easy,
+					 CURLOPT_TIMEOUT_MS, left);
+			fetch->deadline = true;
+		}
+	}
 
 	if (psys->auth != NULL)
 	    psys->auth(fetch);
@@ -126,6 +196,15 @@ create_fetch(query_t query, char *url) {
 	curl_easy_setopt(fetch->easy, CURLOPT_WRITEFUNCTION, writer_func);
 	curl_easy_setopt(fetch->easy, CURLOPT_WRITEDATA, fetch);
 	curl_easy_setopt(fetch->easy, CURLOPT_PRIVATE, fetch);
+	/* --raw and --count take whatever each callback gets, so make those
+	 * large.
+	 */
+	if (raw_output || count_only)
+		curl_easy_setopt(fetch->easy, CURLOPT_BUFFERSIZE, 512L * 1024L);
+	/* offer every encoding libcurl can decode; for bulk pulls the
+	 * bandwidth is most of the cost.
+	 */
+	curl_easy_setopt(fetch->easy, CURLOPT_ACCEPT_ENCODING, "");
 #ifdef CURL_AT_LEAST_VERSION
 /* If CURL_AT_LEAST_VERSION is not defined then the curl is probably too old */
 #if CURL_AT_LEAST_VERSION(7,42,0)
@@ -135,8 +214,9 @@ create_fetch(query_t query, char *url) {
 #endif /* CURL_AT_LEAST_VERSION */
 	if (debug_level >= 3)
 		curl_easy_setopt(fetch->easy, CURLOPT_VERBOSE, 1L);
-
-	fetch->query->fetch = fetch;
+	/* a hedge must not wait behind whatever is slowing the first. */
+	if (fresh)
+		curl_easy_setopt(fetch->easy, CURLOPT_FRESH_CONNECT, 1L);
 
 	res = curl_multi_add_handle(multi, fetch->easy);
 	if (res != CURLM_OK) {
@@ -144,12 +224,25 @@ create_fetch(query_t query, char *url) {
 			curl_multi_strerror(res));
 		my_exit(1);
 	}
+	gettimeofday(&fetch->started, NULL);
+	aimd_start();
+	quota_spend();
+	fetch->next = fetches;
+	fetches = fetch;
+	return fetch;
 }
 
 /* fetch_reap -- reap one fetch.
  */
 static void
 fetch_reap(fetch_t fetch) {
+	fetch_t *pp;
+
+	for (pp = &fetches; *pp != NULL; pp = &(*pp)->next)
+		if (*pp == fetch) {
+			*pp = fetch->next;
+			break;
+		}
 	if (fetch->easy != NULL) {
 		curl_multi_remove_handle(multi, fetch->easy);
 		curl_easy_cleanup(fetch->easy);
@@ -159,8 +252,11 @@ fetch_reap(fetch_t fetch) {
 		curl_slist_free_all(fetch->hdrs);
 		fetch->hdrs = NULL;
 	}
+	endpoint_release(fetch->endpoint);
+	aimd_end();
 	DESTROY(fetch->url);
 	DESTROY(fetch->buf);
+	budget_give(fetch->size);
 	DESTROY(fetch);
 }
 
@@ -215,28 +311,48 @@ query_status(query_t query, const char *status, const char *message) {
 size_t
 writer_func(char *ptr, size_t size, size_t nmemb, void *blob) {
 	fetch_t fetch = (fetch_t) blob;
+	long rows = fetch_rows(fetch);
+	size_t taken;
+
+	DEBUG(3, true, "writer_func(%d, %d): %d\n",
+	      (int)size, (int)nmemb, (int)(size * nmemb));
+	taken = writer_block(fetch, ptr, size * nmemb);
+	/* the rows the block held go toward the concurrency epoch's rate. */
+	aimd_rows(fetch_rows(fetch) - rows);
+	return (taken);
+}
+
+/* writer_block -- process a block of json text for writer_func().
+ */
+static size_t
+writer_block(fetch_t fetch, char *ptr, size_t bytes) {
 	query_t query = fetch->query;
-	writer_t writer = query->writer;
-	size_t bytes = size * nmemb;
+	size_t keep = bytes;
 	char *nl;
 
-	DEBUG(3, true, "writer_func(%d, %d): %d\n",
-	      (int)size, (int)nmemb, (int)bytes);
+	/* the loser of a hedged race is ignored until it is reaped. */
+	if (fetch->lost)
+		return (bytes);
+	if (fetch->easy != NULL && fetch->rcode == 0)
+		curl_easy_getinfo(fetch->easy, CURLINFO_RESPONSE_CODE,
+				  &fetch->rcode);
+	if (!fetch->answered)
+		fetch_answered(fetch);
 
-	fetch->buf = realloc(fetch->buf, fetch->len + bytes);
-	memcpy(fetch->buf + fetch->len, ptr, bytes);
-	fetch->len += bytes;
+	/* --raw and --count pass a successful response through unparsed. */
+	if ((raw_output || count_only) && fetch->easy != NULL &&
+	    fetch->rcode == HTTP_OK)
+		return (raw_writer(fetch, ptr, bytes));
 
 	/* when the fetch is a live web result, emit
 	 * !2xx errors and info payloads as reports.
 	 */
 	if (fetch->easy != NULL) {
-		if (fetch->rcode == 0)
-			curl_easy_getinfo(fetch->easy,
-					  CURLINFO_RESPONSE_CODE,
-					  &fetch->rcode);
+		/* one of a hedged pair failing leaves the other to answer. */
+		if (fetch->rcode != HTTP_OK && query->hedge != NULL)
+			return (bytes);
 		if (fetch->rcode != HTTP_OK) {
-			char *message = strndup(fetch->buf, fetch->len);
+			char *message = strndup(ptr, bytes);
 
 			/* only report the first line of data. */
 			char *eol = strpbrk(message, "\r\n");
@@ -274,13 +390,64 @@ writer_func(char *ptr, size_t size, size_t nmemb, void *blob) {
 				my_logf("warning: libcurl: [%s]",
 					message);
 			DESTROY(message);
-			fetch->buf[0] = '\0';
-			fetch->len = 0;
 			return (bytes);
 		}
 	}
 
-	/* deblock. */
+	/* the block is buffered and charged to --max-memory a line at a
+	 * time.  a line that will not fit is dropped, and the rest of it
+	 * skipped as it arrives, rather than buffered whole.
+	 */
+	while (keep > 0) {
+		size_t take;
+
+		if (fetch->skipping) {
+			nl = memchr(ptr, '\n', keep);
+			if (nl == NULL)
+				return (bytes);
+			fetch->skipping = false;
+			keep -= (size_t)(nl + 1 - ptr);
+			ptr = nl + 1;
+			continue;
+		}
+		nl = memchr(ptr, '\n', keep);
+		take = (nl != NULL) ? (size_t)(nl + 1 - ptr) : keep;
+		if (!budget_resize(&fetch->size, fetch->len + take)) {
+			my_logf("--max-memory: skipping a result line of%s"
+				" %zu bytes", (nl == NULL) ? " over" : "",
+				fetch->len + take);
+			exit_code = 1;
+			fetch->len = 0;
+			fetch->skipping = true;
+			continue;
+		}
+		fetch->buf = realloc(fetch->buf, fetch->size);
+		if (fetch->buf == NULL)
+			my_panic(true, "realloc");
+		memcpy(fetch->buf + fetch->len, ptr, take);
+		fetch->len += take;
+		ptr += take;
+		keep -= take;
+		/* on reaching the output limit, cause CURLE_WRITE_ERROR
+		 * for this transfer.
+		 */
+		if (!deblock(fetch))
+			return (0);
+	}
+
+	return (bytes);
+}
+
+/* deblock -- hand each whole buffered line to data_blob().
+ *
+ * returns false if the output limit was reached, to abort the transfer.
+ */
+static bool
+deblock(fetch_t fetch) {
+	query_t query = fetch->query;
+	writer_t writer = query->writer;
+	char *nl;
+
 	while ((nl = memchr(fetch->buf, '\n', fetch->len)) != NULL) {
 		size_t pre_len = (size_t)(nl - fetch->buf),
 			post_len = (fetch->len - pre_len) - 1;
@@ -290,57 +457,369 @@ writer_func(char *ptr, size_t size, size_t nmemb, void *blob) {
 		{
 			DEBUG(9, true, "hit output limit %ld\n",
 			      writer->output_limit);
-			/* cause CURLE_WRITE_ERROR for this transfer. */
-			bytes = 0;
 			query->saf_cond = sc_we_limited;
 			/* inform io_engine() that the abort is intentional. */
 			fetch->stopped = true;
-		} else {
-			query->writer->count +=
-				data_blob(query, fetch->buf, pre_len);
-
-			switch (query->saf_cond) {
-			case sc_init:
-			case sc_begin:
-			case sc_ongoing:
-			case sc_missing:
-				break;
-			case sc_succeeded:
-			case sc_limited:
-			case sc_failed:
-			case sc_we_limited:
-				/* inform io_engine() intentional
-				 * abort. */
-				fetch->stopped = true;
-				break;
-			}
+			return false;
+		}
+		writer->count += data_blob(query, fetch->buf, pre_len);
+
+		switch (query->saf_cond) {
+		case sc_init:
+		case sc_begin:
+		case sc_ongoing:
+		case sc_missing:
+			break;
+		case sc_succeeded:
+		case sc_limited:
+		case sc_failed:
+		case sc_we_limited:
+			/* inform io_engine() intentional abort. */
+			fetch->stopped = true;
+			break;
 		}
 		memmove(fetch->buf, nl + 1, post_len);
 		fetch->len = post_len;
 	}
+	return true;
+}
+
+/* raw_writer -- write a block of json text out as it came, for --raw.
+ *
+ * whole lines go straight from libcurl's buffer to stdout, with only a
+ * partial line at the end held back.  each line is looked at just enough
+ * to find a SAF "cond" and to count results toward the output limit.
+ */
+static size_t
+raw_writer(fetch_t fetch, const char *ptr, size_t bytes) {
+	query_t query = fetch->query;
+	writer_t writer = query->writer;
+	const char *line = ptr, *end = ptr + bytes, *nl;
+
+	/* finish a line held back from the last block. */
+	if (fetch->len != 0) {
+		nl = memchr(ptr, '\n', bytes);
+		if (nl == NULL)
+			nl = end - 1;
+		if (!budget_resize(&fetch->size,
+				   fetch->len + (size_t)(nl + 1 - ptr)))
+		{
+			my_logf("--max-memory: cannot hold a result line of"
+				" over %zu bytes", fetch->size);
+			my_exit(1);
+		}
+		fetch->buf = realloc(fetch->buf, fetch->size);
+		if (fetch->buf == NULL)
+			my_panic(true, "realloc");
+		memcpy(fetch->buf + fetch->len, ptr, (size_t)(nl + 1 - ptr));
+		fetch->len += (size_t)(nl + 1 - ptr);
+		line = nl + 1;
+		if (*nl != '\n')
+			return (bytes);
+		if (count_only) {
+			count_lines(fetch, fetch->buf, fetch->len);
+		} else {
+			raw_put(fetch->buf, fetch->len);
+			writer->count += raw_sniff(query, fetch->buf,
+						   fetch->len - 1);
+		}
+		fetch->len = 0;
+		if (raw_stop(fetch))
+			return (query->saf_cond == sc_we_limited) ? 0 : bytes;
+	}
 
+	/* count whole lines all at once. */
+	if (count_only) {
+		nl = (line < end) ? memrchr(line, '\n', (size_t)(end - line))
+				  : NULL;
+		if (nl != NULL) {
+			count_lines(fetch, line, (size_t)(nl + 1 - line));
+			line = nl + 1;
+			if (raw_stop(fetch))
+				return (bytes);
+		}
+	}
+
+	/* pass whole lines through in one write. */
+	ptr = line;
+	while (line < end && (nl = memchr(line, '\n',
+					  (size_t)(end - line))) != NULL)
+	{
+		writer->count += raw_sniff(query, line, (size_t)(nl - line));
+		line = nl + 1;
+		if (raw_stop(fetch)) {
+			raw_put(ptr, (size_t)(line - ptr));
+			return (query->saf_cond == sc_we_limited) ? 0 : bytes;
+		}
+	}
+	raw_put(ptr, (size_t)(line - ptr));
+
+	/* hold back a partial line. */
+	if (line < end) {
+		if (!budget_resize(&fetch->size, (size_t)(end - line))) {
+			my_logf("--max-memory: cannot hold a result line of"
+				" over %zu bytes", (size_t)(end - line));
+			my_exit(1);
+		}
+		fetch->buf = realloc(fetch->buf, fetch->size);
+		if (fetch->buf == NULL)
+			my_panic(true, "realloc");
+		memcpy(fetch->buf, line, (size_t)(end - line));
+		fetch->len = (size_t)(end - line);
+	}
 	return (bytes);
 }
 
+/* count_lines -- count the results in a run of whole lines, for --count.
+ *
+ * every line is taken to be a result except those naming a SAF "cond" or
+ * "msg", which are rare enough to be parsed properly by data_blob().
+ */
+static void
+count_lines(fetch_t fetch, const char *buf, size_t len) {
+	query_t query = fetch->query;
+	const char *end = buf + len, *p = buf;
+	const char *cond = NULL, *msg = NULL;
+
+	query->writer->count += (int)count_newlines(buf, len);
+	while (p < end) {
+		const char *hit, *eol, *bol;
+
+		if (cond == NULL || cond < p)
+			cond = memmem(p, (size_t)(end - p), "\"cond\":", 7);
+		if (msg == NULL || msg < p)
+			msg = memmem(p, (size_t)(end - p), "\"msg\":", 6);
+		if (cond == NULL && msg == NULL)
+			break;
+		hit = (cond == NULL) ? msg
+			: (msg == NULL || cond < msg) ? cond : msg;
+		bol = memrchr(buf, '\n', (size_t)(hit - buf));
+		bol = (bol == NULL) ? buf : bol + 1;
+		eol = memchr(hit, '\n', (size_t)(end - hit));
+		if (eol == NULL)
+			eol = end;
+		if (data_blob(query, bol, (size_t)(eol - bol)) == 0)
+			query->writer->count--;
+		p = eol + 1;
+	}
+}
+
+/* count_newlines -- count the newlines in a buffer, eight bytes at a time.
+ *
+ * the inner loop has no branches on the data, so compilers vectorize it.
+ */
+static size_t
+count_newlines(const char *buf, size_t len) {
+	const uint64_t ones = 0x0101010101010101ULL,
+		highs = 0x8080808080808080ULL,
+		nls = ones * '\n';
+	size_t n = 0, i = 0;
+
+	for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+		uint64_t w;
+
+		memcpy(&w, buf + i, sizeof w);
+		w ^= nls;
+		/* a byte's high bit survives only if the byte was zero. */
+		w = ~(((w & ~highs) + ~highs) | w) & highs;
+		n += (size_t)__builtin_popcountll(w);
+	}
+	for (; i < len; i++)
+		n += (buf[i] == '\n');
+	return n;
+}
+
+/* raw_sniff -- note a line's SAF "cond" and "msg" without parsing it.
+ *
+ * inside a JSON string a quote is escaped, so "cond": can only be a key.
+ * returns 1 if the line holds a result, else 0.
+ */
+static int
+raw_sniff(query_t query, const char *line, size_t len) {
+	static const struct {
+		const char	*name;
+		saf_cond_e	 cond;
+	} conds[] = {
+		{ "begin\"", sc_begin },
+		{ "ongoing\"", sc_ongoing },
+		{ "succeeded\"", sc_succeeded },
+		{ "limited\"", sc_limited },
+		{ "failed\"", sc_failed },
+	};
+	const char *p, *end = line + len;
+	size_t i;
+
+	p = memmem(line, len, "\"msg\":\"", 7);
+	if (p != NULL) {
+		const char *q;
+
+		p += 7;
+		for (q = p; q < end && *q != '"'; q++)
+			if (*q == '\\' && q + 1 < end)
+				q++;
+		DESTROY(query->saf_msg);
+		query->saf_msg = strndup(p, (size_t)(q - p));
+	}
+
+	p = memmem(line, len, "\"cond\":", 7);
+	if (p != NULL) {
+		for (p += 7; p < end && *p == ' '; p++)
+			continue;
+		if (p < end && *p == '"') {
+			p++;
+			for (i = 0; i < sizeof conds / sizeof conds[0]; i++) {
+				size_t n = strlen(conds[i].name);
+
+				if ((size_t)(end - p) >= n &&
+				    memcmp(p, conds[i].name, n) == 0)
+					break;
+			}
+		} else {
+			i = sizeof conds / sizeof conds[0];
+		}
+		if (i < sizeof conds / sizeof conds[0]) {
+			query->saf_cond = conds[i].cond;
+		} else {
+			query->saf_cond = sc_missing;
+			my_logf("Unknown value for \"cond\": %.*s",
+				(int)(end - p), p);
+		}
+	}
+
+	return (memmem(line, len, "\"obj\":", 6) != NULL) ? 1 : 0;
+}
+
+/* raw_stop -- true if the query is over, by SAF cond or output limit.
+ */
+static bool
+raw_stop(fetch_t fetch) {
+	query_t query = fetch->query;
+	writer_t writer = query->writer;
+
+	if (writer->output_limit > 0 &&
+	    writer->count >= writer->output_limit)
+	{
+		DEBUG(9, true, "hit output limit %ld\n", writer->output_limit);
+		/* a block may hold more lines than the limit let through. */
+		writer->count = (int)writer->output_limit;
+		query->saf_cond = sc_we_limited;
+	}
+	switch (query->saf_cond) {
+	case sc_init:
+	case sc_begin:
+	case sc_ongoing:
+	case sc_missing:
+		return false;
+	case sc_succeeded:
+	case sc_limited:
+	case sc_failed:
+	case sc_we_limited:
+		/* inform io_engine() intentional abort. */
+		fetch->stopped = true;
+		return true;
+	}
+	return false;
+}
+
+/* raw_put -- write bytes to stdout, bypassing stdio.
+ */
+static void
+raw_put(const char *buf, size_t len) {
+	while (len > 0) {
+		ssize_t n = write(STDOUT_FILENO, buf, len);
+
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			/* the reader has gone away; so may we. */
+			if (errno == EPIPE)
+				my_exit(exit_code);
+			my_panic(true, "write");
+		}
+		buf += n;
+		len -= (size_t)n;
+	}
+}
+
 /* query_done -- do something with leftover buffer data when a query ends.
  */
 static void
 query_done(query_t query) {
 	DEBUG(2, true, "query_done(%s)\n", query->command);
 
-	if (!quiet) {
+	/* --exhaustive reports on its own windows. */
+	if (!quiet && !exhaustive) {
 		const char *msg = or_else(query->saf_msg, "");
+		/* with --fanout-rrtypes or --batch, say which of the queries
+		 * this is.
+		 */
+		const char *type = fanout ? query->qd.rrtype
+			: batch_run ? query->command : NULL;
+		const char *sep = (fanout || batch_run) ? " " : "";
 
 		if (query->saf_cond == sc_limited)
-			fprintf(stderr, "Query limited: %s\n", msg);
+			fprintf(stderr, "Query%s%s limited: %s\n",
+				sep, or_else(type, ""), msg);
 		else if (query->saf_cond == sc_failed)
-			fprintf(stderr, "Query failed: %s\n", msg);
+			fprintf(stderr, "Query%s%s failed: %s\n",
+				sep, or_else(type, ""), msg);
 		else if (query->saf_cond == sc_missing)
-			fprintf(stderr, "Query response_missing: %s\n", msg);
-		else if (query->status != NULL)
-			fprintf(stderr, "Query status: %s (%s)\n",
+			fprintf(stderr, "Query%s%s response_missing: %s\n",
+				sep, or_else(type, ""), msg);
+		else if (query->status != NULL &&
+			 !(nshards != 0 && query->writer->count == 0 &&
+			   strcmp(query->status, status_noerror) == 0))
+			/* but a --shard finding nothing is unremarkable. */
+			fprintf(stderr, "Query%s%s status: %s (%s)\n",
+				sep, or_else(type, ""),
 				query->status, query->message);
 	}
+
+	/* --count prints just the number of results and how the query
+	 * ended.
+	 */
+	if (count_only) {
+		json_t *obj = json_object();
+
+		json_object_set_new(obj, "count",
+				    json_integer(query->writer->count));
+		if (fanout)
+			json_object_set_new(obj, "rrtype",
+					    json_string(query->qd.rrtype));
+		if (batch_run)
+			json_object_set_new(obj, "query",
+					    json_string(query->command));
+		json_object_set_new(obj, "cond",
+			json_string(query_cut(query) ? "deadline"
+				    : saf_cond_name(query->saf_cond)));
+		if (query->saf_msg != NULL)
+			json_object_set_new(obj, "msg",
+					    json_string(query->saf_msg));
+		json_dumpf(obj, stdout, JSON_INDENT(0) | JSON_COMPACT);
+		putchar('\n');
+		json_decref(obj);
+	}
+}
+
+/* saf_cond_name -- how a query ended, as --count reports it.
+ */
+static const char *
+saf_cond_name(saf_cond_e cond) {
+	switch (cond) {
+	case sc_succeeded:
+		return "succeeded";
+	case sc_limited:
+	case sc_we_limited:
+		return "limited";
+	case sc_failed:
+		return "failed";
+	case sc_init:
+	case sc_begin:
+	case sc_ongoing:
+	case sc_missing:
+		break;
+	}
+	return "missing";
 }
 
 /* writer_fini -- stop a writer's fetch
@@ -351,6 +830,14 @@ writer_fini(writer_t writer) {
 	if (writer->query != NULL) {
 		query_t query = writer->query;
 
+		retry_unlink(query);
+
+		/* a hedge still racing is of no more use. */
+		if (query->hedge != NULL) {
+			fetch_reap(query->hedge);
+			query->hedge = NULL;
+		}
+
 		/* release any buffered info. */
 		if (query->fetch != NULL) {
 			DESTROY(query->fetch->buf);
@@ -370,6 +857,7 @@ writer_fini(writer_t writer) {
 		DESTROY(query->status);
 		DESTROY(query->message);
 		DESTROY(query->command);
+		DESTROY(query->saf_msg);
 		DESTROY(query);
 	}
 
@@ -390,11 +878,22 @@ io_engine(int jobs) {
 
 	DEBUG(2, true, "io_engine(%d)\n", jobs);
 
-	/* let libcurl run while there are too many jobs remaining. */
+	/* let libcurl run while there are too many jobs remaining, which
+	 * a failover or a retry at the very end can make so again.
+	 */
+ again:
 	still = 0;
 	repeats = 0;
-	while (curl_multi_perform(multi, &still) == CURLM_OK && still > jobs) {
+	while (curl_multi_perform(multi, &still) == CURLM_OK &&
+	       (still > jobs || waiting != NULL))
+	{
 		DEBUG(3, true, "...waiting (still %d)\n", still);
+		if (waiting != NULL)
+			retry_check();
+		if (hedge_ms != 0L)
+			hedge_check();
+		if (aimd_active())
+			aimd_tick();
 		numfds = 0;
 		if (curl_multi_wait(multi, NULL, 0, 0, &numfds) != CURLM_OK)
 			break;
@@ -415,18 +914,24 @@ io_engine(int jobs) {
 		} else {
 			repeats = 0;
 		}
-		io_drain();
+		(void) io_drain();
 	}
-	io_drain();
+	if (io_drain())
+		goto again;
 }
 
 /* io_drain -- drain the response code reports.
+ *
+ * returns true if a query was resumed on another server or set aside to
+ * try again.
  */
-static void
+static bool
 io_drain(void) {
 	struct CURLMsg *cm;
 	int still = 0;
+	bool resumed = false;
 
+	hedge_reap();
 	while ((cm = curl_multi_info_read(multi, &still)) != NULL) {
 		fetch_t fetch;
 		query_t query;
@@ -438,7 +943,17 @@ io_drain(void) {
 		fetch = (fetch_t) private;
 		query = fetch->query;
 
-		if (cm->msg == CURLMSG_DONE) {
+		if (cm->msg == CURLMSG_DONE && fetch->lost) {
+			fetch_reap(fetch);
+		} else if (cm->msg == CURLMSG_DONE && query->hedge != NULL) {
+			/* one of a hedged pair ended in error before the
+			 * other answered; the other carries on alone.
+			 */
+			query->fetch = (fetch == query->fetch)
+				? query->hedge : query->fetch;
+			query->hedge = NULL;
+			fetch_reap(fetch);
+		} else if (cm->msg == CURLMSG_DONE) {
 			if (fetch->rcode == 0)
 				curl_easy_getinfo(fetch->easy,
 						  CURLINFO_RESPONSE_CODE,
@@ -450,6 +965,38 @@ io_drain(void) {
 			      query->saf_cond,
 			      or_else(query->saf_msg, ""));
 
+			aimd_result(fetch->rcode,
+				    fetch->answered ? fetch->ttfb : -1L,
+				    elapsed_ms(&fetch->started));
+
+			/* a server which could not be reached, or which
+			 * failed or dropped the stream, is avoided for a
+			 * while, and the query resumed on another.
+			 */
+			if (failover_wanted(fetch, cm->data.result)) {
+				endpoint_failed(fetch->endpoint);
+				if (failover(fetch)) {
+					resumed = true;
+					continue;
+				}
+			}
+			/* a server pushing back is given time. */
+			if (retry_later(fetch)) {
+				resumed = true;
+				continue;
+			}
+
+			/* a fetch cut off by --deadline keeps what came. */
+			if (cm->data.result == CURLE_OPERATION_TIMEDOUT &&
+			    fetch->deadline)
+			{
+				fetch->stopped = true;
+				deadline_hit = true;
+				if (query->status == NULL)
+					query_status(query, status_deadline,
+						     "cut off by --deadline");
+			}
+
 			if (cm->data.result == CURLE_COULDNT_RESOLVE_HOST) {
 				my_logf(
 					"warning: libcurl failed since "
@@ -484,9 +1031,332 @@ io_drain(void) {
 			fetch_done(fetch);
 			fetch_unlink(fetch);
 			fetch_reap(fetch);
+			if (exhaustive)
+				exhaustive_done(query);
+			else if (batch_run)
+				sched_done(query);
 		}
 		DEBUG(3, true, "...info read (still %d)\n", still);
 	}
+	return resumed;
+}
+
+/* deadline_left -- milliseconds left before --deadline, which counts
+ * from startup; LONG_MAX if there is none.
+ */
+long
+deadline_left(void) {
+	if (deadline_ms == 0L)
+		return LONG_MAX;
+	return deadline_ms - elapsed_ms(&startup_time);
+}
+
+/* hedge_report -- say what --hedge did.
+ */
+void
+hedge_report(void) {
+	if (hedge_ms != 0L && !quiet)
+		my_logf("--hedge: %lu of %lu fetch(es) hedged, %lu won by"
+			" the hedge", nhedges, nfetches, nhedge_wins);
+}
+
+/* fetch_answered -- a fetch has its first byte.  learn how long that
+ * took, and if it is one of a hedged pair and a success, it wins: it
+ * becomes the query's fetch, and the other is left for hedge_reap(),
+ * since a handle cannot be removed from within a libcurl callback.  an
+ * error wins nothing; it ends only its own fetch.
+ */
+static void
+fetch_answered(fetch_t fetch) {
+	query_t query = fetch->query;
+
+	fetch->answered = true;
+	fetch->ttfb = elapsed_ms(&fetch->started);
+	ttfb[nttfb++ % HEDGE_SAMPLES] = fetch->ttfb;
+	if (query->hedge == NULL ||
+	    (fetch->easy != NULL && fetch->rcode != HTTP_OK))
+		return;
+	if (fetch == query->hedge) {
+		query->fetch->lost = true;
+		query->fetch = fetch;
+		nhedge_wins++;
+	} else {
+		query->hedge->lost = true;
+	}
+	query->hedge = NULL;
+}
+
+/* hedge_check -- start a second fetch, on a fresh connection, for each
+ * fetch not answered within the threshold, unless hedges would then be
+ * over --hedge-budget percent of all fetches.
+ */
+static void
+hedge_check(void) {
+	long threshold = hedge_threshold();
+	endpoint_t endpoint;
+	fetch_t fetch;
+
+	for (fetch = fetches; fetch != NULL; fetch = fetch->next) {
+		query_t query = fetch->query;
+
+		if (fetch->answered || fetch->lost || query == NULL ||
+		    query->fetch != fetch || query->hedged ||
+		    elapsed_ms(&fetch->started) < threshold)
+			continue;
+		/* the first hedge is always allowed, or a single query could
+		 * never have one.
+		 */
+		if (nhedges * 100 >=
+		    (unsigned long)hedge_pct * (nfetches + 1) ||
+		    quota_left() <= 0L)
+			return;
+		DEBUG(1, true, "hedging %s after %ld ms\n",
+		      query->command, elapsed_ms(&fetch->started));
+		/* the new fetch goes on the head of the list, behind us.
+		 * with several servers, it goes to another one.
+		 */
+		endpoint = endpoint_pick(fetch->endpoint);
+		if (endpoint == NULL)
+			query->hedge = fetch_new(query, strdup(fetch->url),
+						 fetch->endpoint, true);
+		else
+			query->hedge = fetch_new(query,
+						 query_url(&query->qd,
+							   query->command,
+							   endpoint),
+						 endpoint, true);
+		query->hedged = true;
+		nhedges++;
+	}
+}
+
+/* failover_wanted -- true if a fetch ended for want of its server: it
+ * could not connect, the transfer broke off, or the server answered
+ * with an error of its own, all before the query reached an end.
+ */
+static bool
+failover_wanted(const struct fetch *fetch, CURLcode result) {
+	switch (fetch->query->saf_cond) {
+	case sc_init:
+	case sc_begin:
+	case sc_ongoing:
+	case sc_missing:
+		break;
+	case sc_succeeded:
+	case sc_limited:
+	case sc_failed:
+	case sc_we_limited:
+		return false;
+	}
+	if (fetch->stopped)
+		return false;
+	if (result == CURLE_OK)
+		return fetch->rcode >= 500;
+	if (result == CURLE_OPERATION_TIMEDOUT)
+		return !fetch->deadline;
+	return result == CURLE_COULDNT_RESOLVE_HOST ||
+		result == CURLE_COULDNT_CONNECT ||
+		result == CURLE_SEND_ERROR ||
+		result == CURLE_RECV_ERROR ||
+		result == CURLE_PARTIAL_FILE ||
+		result == CURLE_GOT_NOTHING;
+}
+
+/* failover -- resume a query whose fetch failed on another server,
+ * asking for the results after those already had.  each query may fail
+ * over once per server.
+ *
+ * returns true if the failed fetch has been replaced (and reaped).
+ */
+static bool
+failover(fetch_t fetch) {
+	query_t query = fetch->query;
+	struct qdesc qd = query->qd;
+	endpoint_t endpoint;
+	long rows;
+	char *url;
+
+	if (query->failovers >= endpoints_count() || deadline_left() <= 0L ||
+	    quota_left() <= 0L)
+		return false;
+	endpoint = endpoint_pick(fetch->endpoint);
+	if (endpoint == NULL)
+		return false;
+
+	rows = fetch_rows(fetch);
+	/* a --limit of 0 asks for as many as the server allows. */
+	if (qd.query_limit > 0) {
+		if (rows >= qd.query_limit)
+			return false;
+		qd.query_limit -= rows;
+	}
+	qd.offset += rows;
+	query->qd = qd;
+	query->rows = 0;
+	query->failovers++;
+
+	/* forget the failure, and anything left of a partial line. */
+	DESTROY(query->status);
+	DESTROY(query->message);
+	url = query_url(&query->qd, query->command, endpoint);
+	if (!quiet)
+		my_logf("resuming %s at offset %ld on %s",
+			query->command, qd.offset, endpoint->base);
+	DEBUG(1, true, "url [%s]\n", url);
+	fetch_reap(fetch);
+	create_fetch(query, url, endpoint);
+	return true;
+}
+
+/* fetch_rows -- how many results the server has sent a query's fetch.
+ */
+static long
+fetch_rows(const struct fetch *fetch) {
+	const struct query *query = fetch->query;
+
+	/* --raw and --count see every result the server sent. */
+	if (raw_output || count_only)
+		return query->writer->count;
+	return query->rows;
+}
+
+/* retry_later -- if a fetch of a run the concurrency window drives was
+ * pushed back by its server (HTTP 429 or 503) before any result, put its
+ * query aside to try again later.
+ *
+ * returns true if the fetch has been reaped and its query set aside.
+ */
+static bool
+retry_later(fetch_t fetch) {
+	query_t query = fetch->query;
+	long wait = AIMD_RETRY_MS << query->retries;
+
+	/* only the runs that the concurrency window drives hold back. */
+	if (!aimd_active() ||
+	    (fetch->rcode != HTTP_TOO_MANY_REQUESTS &&
+	     fetch->rcode != HTTP_SERVICE_UNAVAILABLE) ||
+	    fetch_rows(fetch) != 0 || query->retries >= AIMD_RETRIES ||
+	    quota_left() <= 0L)
+		return false;
+#ifdef CURL_AT_LEAST_VERSION
+#if CURL_AT_LEAST_VERSION(7,66,0)
+	{
+		curl_off_t after = 0;
+
+		if (curl_easy_getinfo(fetch->easy, CURLINFO_RETRY_AFTER,
+				      &after) == CURLE_OK && after > 0)
+			wait = (long)after * 1000L;
+	}
+#endif
+#endif /* CURL_AT_LEAST_VERSION */
+	if (wait >= deadline_left())
+		return false;
+
+	query->retries++;
+	query->retry_at = elapsed_ms(&startup_time) + wait;
+	DESTROY(query->status);
+	DESTROY(query->message);
+	DEBUG(1, true, "retrying %s in %ld ms\n", query->command, wait);
+	fetch_reap(fetch);
+	query->fetch = NULL;
+	query->waiting = waiting;
+	waiting = query;
+	return true;
+}
+
+/* retry_check -- start again those queries whose wait is over.
+ */
+static void
+retry_check(void) {
+	long now = elapsed_ms(&startup_time);
+	query_t *pp = &waiting, query;
+
+	while ((query = *pp) != NULL) {
+		endpoint_t endpoint;
+		char *url;
+
+		if (query->retry_at > now) {
+			pp = &query->waiting;
+			continue;
+		}
+		*pp = query->waiting;
+		query->waiting = NULL;
+		endpoint = endpoint_pick(NULL);
+		url = query_url(&query->qd, query->command, endpoint);
+		DEBUG(1, true, "url [%s]\n", url);
+		create_fetch(query, url, endpoint);
+	}
+}
+
+/* retry_unlink -- take a query off the waiting list, if it is there.
+ */
+static void
+retry_unlink(query_t query) {
+	query_t *pp;
+
+	for (pp = &waiting; *pp != NULL; pp = &(*pp)->waiting)
+		if (*pp == query) {
+			*pp = query->waiting;
+			break;
+		}
+}
+
+/* hedge_reap -- remove the fetches which lost a hedged race.
+ */
+static void
+hedge_reap(void) {
+	fetch_t fetch, next;
+
+	for (fetch = fetches; fetch != NULL; fetch = next) {
+		next = fetch->next;
+		if (fetch->lost)
+			fetch_reap(fetch);
+	}
+}
+
+/* hedge_threshold -- how long a fetch may go unanswered before it is
+ * hedged: as given, or for --hedge auto, learned from recent fetches.
+ */
+static long
+hedge_threshold(void) {
+	long sorted[HEDGE_SAMPLES];
+	size_t n = (nttfb < HEDGE_SAMPLES) ? nttfb : HEDGE_SAMPLES;
+
+	if (hedge_ms > 0L)
+		return hedge_ms;
+	if (n < HEDGE_MIN_SAMPLES)
+		return HEDGE_DEFAULT_MS;
+	memcpy(sorted, ttfb, n * sizeof *sorted);
+	qsort(sorted, n, sizeof *sorted, long_cmp);
+	return sorted[(n - 1) * HEDGE_PERCENTILE / 100];
+}
+
+/* long_cmp -- qsort() order for longs.
+ */
+static int
+long_cmp(const void *a, const void *b) {
+	long x = *(const long *)a, y = *(const long *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* elapsed_ms -- milliseconds since a time.
+ */
+long
+elapsed_ms(const struct timeval *since) {
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - since->tv_sec) * 1000L +
+		(now.tv_usec - since->tv_usec) / 1000L;
+}
+
+/* query_cut -- true if --deadline ended this query early.
+ */
+bool
+query_cut(const struct query *query) {
+	return query->status != NULL &&
+		strcmp(query->status, status_deadline) == 0;
 }
 
 /* escape -- HTML-encode a string, in place.
@@ -508,3 +1378,23 @@ escape(CURL *easy, char **str) {
 	curl_free(escaped);
 	escaped = NULL;
 }
+
+/* unescape -- undo escape(), in place.
+ */
+void
+unescape(CURL *easy, char **str) {
+	char *plain;
+
+	if (*str == NULL)
+		return;
+	plain = curl_easy_unescape(easy, *str, (int)strlen(*str), NULL);
+	if (plain == NULL) {
+		my_logf("curl_unescape(%s) failed",
+			*str);
+		my_exit(1);
+	}
+	DESTROY(*str);
+	*str = strdup(plain);
+	curl_free(plain);
+	plain = NULL;
+}
@@ -17,6 +17,8 @@
 #ifndef NETIO_H_INCLUDED
 #define NETIO_H_INCLUDED 1
 
+#include <sys/time.h>
+
 #include <stdbool.h>
 #include <curl/curl.h>
 
@@ -61,15 +63,30 @@ struct fetch {
 	struct curl_slist  *hdrs;
 	char		*url;
 	char		*buf;
-	size_t		len;
+	size_t		len, size;
 	long		rcode;
 	bool		stopped;
+	bool		skipping;	/* a line over --max-memory */
+	bool		deadline;	/* its timeout is --deadline's */
+	bool		answered;	/* the first byte has come */
+	bool		lost;		/* its hedged pair answered first */
+	struct endpoint	*endpoint;	/* the server it went to */
+	struct timeval	started;
+	long		ttfb;		/* ms to the first byte, if answered */
+	struct fetch	*next;		/* all fetches in progress */
 };
 typedef struct fetch *fetch_t;
 
 /* one query. */
 struct query {
 	struct fetch	*fetch;
+	struct fetch	*hedge;		/* a second try, racing the first */
+	bool		hedged;
+	size_t		failovers;	/* times resumed on another server */
+	long		rows;		/* results the server has sent */
+	int		retries;	/* times tried again after pushback */
+	long		retry_at;	/* when, in ms from startup */
+	struct query	*waiting;	/* others waiting to try again */
 	struct writer	*writer;
 	struct qdesc	qd;
 	char		*command;
@@ -87,18 +104,24 @@ struct writer {
 	struct query	*query;
 	long		output_limit;
 	int		count;
+	int		dups;		/* of count, dropped by --dedup */
 };
 typedef struct writer *writer_t;
 
 void make_curl(void);
 void unmake_curl(void);
-void create_fetch(query_t, char *);
+void create_fetch(query_t, char *, struct endpoint *);
 writer_t writer_init(long);
 void query_status(query_t, const char *, const char *);
 size_t writer_func(char *ptr, size_t size, size_t nmemb, void *blob);
 void writer_fini(writer_t);
 void unmake_writers(void);
 void io_engine(int);
+long deadline_left(void);
+long elapsed_ms(const struct timeval *);
+void hedge_report(void);
+bool query_cut(const struct query *);
 void escape(CURL *, char **);
+void unescape(CURL *, char **);
 
 #endif /*NETIO_H_INCLUDED*/
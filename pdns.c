@@ -20,9 +20,23 @@
 #include "defs.h"
 #include "netio.h"
 #include "pdns.h"
+#include "budget.h"
+#include "hash.h"
+#include "suffix.h"
+#include "regset.h"
+#include "sample.h"
+#include "sink.h"
 #include "time.h"
 #include "globals.h"
 
+static void print_unless_repeated(const char *, const char *, FILE *);
+static const char *tuple_parse(pdns_tuple_t, bool);
+
+/* results seen so far, for tuple_first(). */
+static hash_t first_seen = NULL;
+static char *first_key = NULL;
+static size_t first_keysize = 0;
+
 /*
  * List of rrtypes whose rdata values can be printed out literally.
  * This means they contain just a DNS name in them.
@@ -64,16 +78,31 @@ rrtype_ok_to_print_literal(const char *rrtype) {
 	return false;
 }
 
+/* present_matched -- add a batch comment naming any --match-file matches.
+ */
+static void
+present_matched(pdns_tuple_ct tup, FILE *out) {
+	size_t i;
+
+	if (tup->obj.matched == NULL)
+		return;
+	fputs("# matched:", out);
+	for (i = 0; i < json_array_size(tup->obj.matched); i++)
+		fprintf(out, "%c%s", i == 0 ? ' ' : ',',
+			json_string_value(json_array_get(tup->obj.matched, i)));
+	putc('\n', out);
+}
+
 /* present_json -- render one tuple as newline-separated JSON.
  */
 void
 present_json(pdns_tuple_ct tup,
 	     const char *jsonbuf __attribute__ ((unused)),
 	     size_t jsonlen __attribute__ ((unused)),
-	     writer_t writer __attribute__ ((unused)))
+	     sink_t sink)
 {
-	json_dumpf(tup->obj.saf_obj, stdout, JSON_INDENT(0) | JSON_COMPACT);
-	putchar('\n');
+	json_dumpf(tup->obj.saf_obj, sink->out, JSON_INDENT(0) | JSON_COMPACT);
+	putc('\n', sink->out);
 }
 
 /* present_batch -- render one tuple in a dnsdbq batch input file form,
@@ -83,22 +112,24 @@ void
 present_batch(pdns_tuple_ct tup,
 	      const char *jsonbuf __attribute__ ((unused)),
 	      size_t jsonlen __attribute__ ((unused)),
-	      writer_t writer __attribute__ ((unused)))
+	      sink_t sink)
 {
 	if (tup->rrname != NULL) {
-		printf("rrset/name/%s/%s\n", tup->rrname, tup->rrtype);
+		fprintf(sink->out, "rrset/name/%s/%s\n",
+			tup->rrname, tup->rrtype);
 	} else if (tup->rdata != NULL) {
 		if (rrtype_ok_to_print_literal(tup->rrtype))
-		    printf("rdata/name/%s/%s\n",
-			   tup->rdata, tup->rrtype);
+		    fprintf(sink->out, "rdata/name/%s/%s\n",
+			    tup->rdata, tup->rrtype);
 		else {
-			printf("rdata/raw/%s/%s\n",
-			       tup->raw_rdata, tup->rrtype);
-			printf("# rdata/name/%s/%s\n",
-			       tup->rdata, tup->rrtype);
+			fprintf(sink->out, "rdata/raw/%s/%s\n",
+				tup->raw_rdata, tup->rrtype);
+			fprintf(sink->out, "# rdata/name/%s/%s\n",
+				tup->rdata, tup->rrtype);
 		}
 	} else
 		my_panic(true, "present_batch");
+	present_matched(tup, sink->out);
 }
 
 /* present_batch_dedup_rrtype -- render one tuple in a dnsdbq batch input file
@@ -108,44 +139,59 @@ void
 present_batch_dedup_rrtype(pdns_tuple_ct tup,
 	      const char *jsonbuf __attribute__ ((unused)),
 	      size_t jsonlen __attribute__ ((unused)),
-	      writer_t writer __attribute__ ((unused)))
+	      sink_t sink)
 {
-	/* maintain a one-element "cache" of our previous print out */
-#define MAX_BATCH_LINE 8192
-	static char last_printed[MAX_BATCH_LINE] = { '\0' };
-	char new_printed[MAX_BATCH_LINE];
-
 	if (tup->rrname != NULL) {
-		snprintf(new_printed, sizeof new_printed,
-			 "rrset/name/%s\n", tup->rrname);
-		if (strcmp(new_printed, last_printed) != 0) {
-			fputs(new_printed, stdout);
-			strcpy(last_printed, new_printed);
-		}
-		printf("# rrset/name/%s/%s\n", tup->rrname, tup->rrtype);
+		print_unless_repeated("rrset/name/", tup->rrname, sink->out);
+		fprintf(sink->out, "# rrset/name/%s/%s\n",
+			tup->rrname, tup->rrtype);
 	} else if (tup->rdata != NULL) {
 		if (rrtype_ok_to_print_literal(tup->rrtype))
-			snprintf(new_printed, sizeof new_printed,
-				 "rdata/name/%s\n", tup->rdata);
+			print_unless_repeated("rdata/name/", tup->rdata,
+					      sink->out);
 		else
-			snprintf(new_printed, sizeof new_printed,
-				 "rdata/raw/%s\n", tup->raw_rdata);
-		if (strcmp(new_printed, last_printed) != 0) {
-			fputs(new_printed, stdout);
-			strcpy(last_printed, new_printed);
-		}
-		printf("# rdata/name/%s/%s\n", tup->rdata, tup->rrtype);
+			print_unless_repeated("rdata/raw/", tup->raw_rdata,
+					      sink->out);
+		fprintf(sink->out, "# rdata/name/%s/%s\n",
+			tup->rdata, tup->rrtype);
 
 	} else
 		my_panic(true, "present_batch_dedup_rrtype");
+	present_matched(tup, sink->out);
 }
 
+/* print_unless_repeated -- print one prefix/value line, unless it is the
+ * same as the last line printed this way.
+ *
+ * the last line is kept whole, however long, so no two lines compare
+ * equal that are not.
+ */
+static void
+print_unless_repeated(const char *prefix, const char *value, FILE *out) {
+	static char *last_printed = NULL;
+	static size_t last_size = 0;
+	size_t plen = strlen(prefix), vlen = strlen(value);
+
+	if (last_printed != NULL &&
+	    strncmp(last_printed, prefix, plen) == 0 &&
+	    strcmp(last_printed + plen, value) == 0)
+		return;
+	fprintf(out, "%s%s\n", prefix, value);
+	if (plen + vlen + 1 > last_size) {
+		budget_need(plen + vlen + 1 - last_size, "-T's last line");
+		last_size = plen + vlen + 1;
+		last_printed = realloc(last_printed, last_size);
+		if (last_printed == NULL)
+			my_panic(true, "realloc");
+	}
+	memcpy(last_printed, prefix, plen);
+	memcpy(last_printed + plen, value, vlen + 1);
+}
 
 /* tuple_make -- create one DNSDB tuple object out of a JSON object.
  */
 const char *
 tuple_make(pdns_tuple_t tup, const char *buf, size_t len) {
-	const char *msg = NULL;
 	json_error_t error;
 
 	memset(tup, 0, sizeof *tup);
@@ -157,12 +203,48 @@ tuple_make(pdns_tuple_t tup, const char *buf, size_t len) {
 			error.text, error.source);
 		abort();
 	}
+	return tuple_parse(tup, false);
+}
+
+/* tuple_make_saved -- create a tuple from one line of saved output, which
+ * may be a whole SAF line as the server sent it or just the object that
+ * -j printed.
+ *
+ * unlike tuple_make, malformed JSON is an error returned to the caller.
+ */
+const char *
+tuple_make_saved(pdns_tuple_t tup, const char *buf, size_t len) {
+	json_error_t error;
+
+	memset(tup, 0, sizeof *tup);
+	tup->obj.main = json_loadb(buf, len, 0, &error);
+	if (tup->obj.main == NULL)
+		return "malformed JSON";
+	return tuple_parse(tup,
+			   json_object_get(tup->obj.main, "obj") == NULL &&
+			   json_object_get(tup->obj.main, "cond") == NULL &&
+			   json_object_get(tup->obj.main, "msg") == NULL);
+}
+
+/* tuple_parse -- fill in a tuple from its parsed JSON.
+ *
+ * a bare object is the "obj" itself, without the SAF wrapper.
+ */
+static const char *
+tuple_parse(pdns_tuple_t tup, bool bare) {
+	const char *msg = NULL;
+
 	if (debug_level >= 4) {
 		char *pretty = json_dumps(tup->obj.main, JSON_INDENT(2));
 		debug(false, "%s\n", pretty);
 		free(pretty);
 	}
 
+	if (bare) {
+		tup->obj.saf_obj = tup->obj.main;
+		goto fields;
+	}
+
 	tup->obj.saf_cond = json_object_get(tup->obj.main, "cond");
 	if (tup->obj.saf_cond != NULL) {
 		if (!json_is_string(tup->obj.saf_cond)) {
@@ -189,6 +271,7 @@ tuple_make(pdns_tuple_t tup, const char *buf, size_t len) {
 		}
 	}
 
+ fields:
 	tup->obj.rrname = json_object_get(tup->obj.saf_obj, "rrname");
 	if (tup->obj.rrname != NULL) {
 		if (!json_is_string(tup->obj.rrname)) {
@@ -277,7 +360,6 @@ tuple_unmake(pdns_tuple_t tup) {
  */
 int
 data_blob(query_t query, const char *buf, size_t len) {
-	writer_t writer = query->writer;
 	const char *msg;
 	struct pdns_tuple tup;
 	int ret = 0;
@@ -291,6 +373,7 @@ data_blob(query_t query, const char *buf, size_t len) {
 
 	if (tup.msg != NULL) {
 		DEBUG(5, true, "data_blob tup.msg = %s\n", tup.msg);
+		DESTROY(query->saf_msg);
 		query->saf_msg = strdup(tup.msg);
 	}
 
@@ -327,11 +410,121 @@ data_blob(query_t query, const char *buf, size_t len) {
 		DEBUG(4, true, "COF object is empty, i.e. a keepalive\n");
 		goto next;
 	}
+	/* a failover resumes past every result the server sent. */
+	query->rows++;
+
+	if (tuple_excluded(&tup)) {
+		exclude_dropped++;
+		goto next;
+	}
+	if (!tuple_matched(&tup))
+		goto next;
+	if (dedup && !tuple_first(&tup)) {
+		/* presented already, e.g. from a neighbouring --exhaustive
+		 * window, but it still counts toward this one's density.
+		 */
+		query->writer->dups++;
+		ret = 1;
+		goto next;
+	}
 
-	(*presenter)(&tup, buf, len, writer);
+	if (sample_size > 0)
+		present_sample(&tup, buf, len);
+	else
+		sinks_present(&tup, buf, len);
 	ret = 1;
  next:
 	tuple_unmake(&tup);
  more:
 	return (ret);
 }
+
+/* tuple_excluded -- true if --exclude-file drops this result, for those
+ * suffixes that could not be sent to the server.
+ *
+ * this only reads the suffix set, so it is safe to call from threads.
+ */
+bool
+tuple_excluded(pdns_tuple_ct tup) {
+	return exclude_suffixes != NULL &&
+		suffix_match(exclude_suffixes,
+			     or_else(tup->rrname, or_else(tup->rdata, "")));
+}
+
+/* tuple_matched -- apply --match-file: false if no pattern matches this
+ * result, else tag it with the matching pattern IDs.
+ *
+ * the pattern set's DFA is built as it is used, so this is not thread safe.
+ */
+bool
+tuple_matched(pdns_tuple_t tup) {
+	const char *subject;
+	const size_t *which;
+	json_t *matched, *obj;
+	size_t n, i;
+
+	if (match_set == NULL)
+		return true;
+	subject = or_else(tup->rrname, or_else(tup->rdata, ""));
+	n = regset_match(match_set, subject, strlen(subject), &which);
+	if (n == 0)
+		return false;
+	matched = json_array();
+	for (i = 0; i < n; i++)
+		json_array_append_new(matched,
+			json_string(regset_id(match_set, which[i])));
+	/* saved -j output from --input has no SAF wrapper. */
+	obj = json_object_get(tup->obj.main, "obj");
+	json_object_set_new(obj != NULL ? obj : tup->obj.main,
+			    "matched", matched);
+	tup->obj.matched = matched;
+	return true;
+}
+
+/* tuple_first -- true the first time a result is seen, by its rrname or
+ * rdata, rrtype, and raw_rdata; else counted in dedup_dropped.
+ *
+ * the table of results seen is not thread safe.
+ */
+bool
+tuple_first(pdns_tuple_ct tup) {
+	const char *parts[3] = {
+		or_else(tup->rrname, or_else(tup->rdata, "")),
+		or_else(tup->rrtype, ""),
+		or_else(tup->raw_rdata, "")
+	};
+	size_t len = 0, i;
+	bool created;
+
+	if (first_seen == NULL)
+		first_seen = hash_new();
+	for (i = 0; i < 3; i++)
+		len += strlen(parts[i]) + 1;
+	if (len > first_keysize) {
+		first_keysize = len * 2;
+		first_key = realloc(first_key, first_keysize);
+		if (first_key == NULL)
+			my_panic(true, "realloc");
+	}
+	len = 0;
+	for (i = 0; i < 3; i++) {
+		size_t n = strlen(parts[i]) + 1;
+
+		memcpy(first_key + len, parts[i], n);
+		len += n;
+	}
+	(void) hash_put(first_seen, first_key, len, &created);
+	if (!created)
+		dedup_dropped++;
+	return created;
+}
+
+/* tuple_first_fini -- forget the results seen.
+ */
+void
+tuple_first_fini(void) {
+	hash_destroy(first_seen, NULL);
+	first_seen = NULL;
+	DESTROY(first_key);
+	first_keysize = 0;
+}
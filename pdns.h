@@ -28,12 +28,15 @@
  * cof_obj points to the object that contains time_first...num_results.
  * saf_cond, saf_msg, and saf_obj are
  * parsed from main and cof_obj is repointed to saf_obj.
+ *
+ * matched is not from the server; it is an array of --match-file pattern
+ * IDs that data_blob() adds to saf_obj.
  */
 struct pdns_json {
 	json_t *main;
 	const json_t *saf_obj, *saf_cond, *saf_msg,
 		*rrname, *rrtype, *count, *time_first, *time_last,
-		*rdata, *raw_rdata;
+		*rdata, *raw_rdata, *matched;
 };
 
 struct pdns_tuple {
@@ -61,13 +64,15 @@ struct pdns_system {
 	const char	*base_url;
 
 	/* start creating a URL corresponding to a command-path string.
-	 * first argument is the input URL path.
-	 * second is an output parameter pointing to the separator character
+	 * first argument is the base URL of the endpoint to be used.
+	 * second is the input URL path.
+	 * third is an output parameter pointing to the separator character
 	 * (? or &) that the caller should use between any further URL
 	 * parameters.	May be NULL if the caller doesn't care.
-	 * the third argument is search parameters.
+	 * the fourth argument is search parameters.
 	 */
-	char *		(*url)(const char *, char *, qdesc_ct, pdns_fence_ct);
+	char *		(*url)(const char *, const char *, char *,
+			       qdesc_ct, pdns_fence_ct);
 
 	/* add authentication information to the fetch request being created.
 	 * may be NULL if auth is not needed by this pDNS system.
@@ -89,10 +94,18 @@ struct pdns_system {
 
 	/* drop heap storage. */
 	void		(*destroy)(void);
+
+	/* create a URL, given an endpoint's base URL, for the report of
+	 * what is left of the API key's query quota.  may be NULL if this
+	 * pDNS system has no such report.
+	 */
+	char *		(*quota_url)(const char *);
 };
 typedef const struct pdns_system *pdns_system_ct;
 
-typedef void (*present_t)(pdns_tuple_ct, const char *, size_t, writer_t);
+typedef struct sink *sink_t;
+typedef void (*present_t)(pdns_tuple_ct, const char *, size_t, sink_t);
+typedef void (*present_fini_t)(sink_t);
 
 /*
  * Possible variations of output:
@@ -103,17 +116,43 @@ typedef void (*present_t)(pdns_tuple_ct, const char *, size_t, writer_t);
  *
  * -T: batch file output, same name will not be repeated with different rrtypes
  *
+ * --aggregate: no per-tuple output, just one summary line per group at the end.
+ *
+ * --collapse: json, but one line per name listing all of its rrtypes.
+ *
+ * --sketch: no per-tuple output, just approximate distinct and heavy-hitter
+ * counts at the end, in fixed memory.
+ *
+ * --arrow: columnar binary output as an Apache Arrow IPC stream.
+ *
+ * --sqlite: no output, rows are inserted into a SQLite table instead.
+ *
+ * --presenter-plugin: whatever a dlopen()'d plugin makes of each tuple.
+ *
  */
-typedef enum { pres_json, pres_batch, pres_batch_dedup_rrtype } present_e;
-
-void present_json(pdns_tuple_ct, const char *, size_t, writer_t);
-void present_batch(pdns_tuple_ct, const char *, size_t, writer_t);
-void present_batch_dedup_rrtype(pdns_tuple_ct, const char *, size_t, writer_t);
+typedef enum { pres_json, pres_batch, pres_batch_dedup_rrtype,
+	       pres_aggregate, pres_json_grouped, pres_sketch,
+	       pres_arrow, pres_plugin,
+#ifdef WANT_SQLITE
+	       pres_sqlite,
+#endif
+} present_e;
+
+void present_json(pdns_tuple_ct, const char *, size_t, sink_t);
+void present_batch(pdns_tuple_ct, const char *, size_t, sink_t);
+void present_batch_dedup_rrtype(pdns_tuple_ct, const char *, size_t, sink_t);
 const char *tuple_make(pdns_tuple_t, const char *, size_t);
+const char *tuple_make_saved(pdns_tuple_t, const char *, size_t);
 void tuple_unmake(pdns_tuple_t);
+bool tuple_excluded(pdns_tuple_ct);
+bool tuple_matched(pdns_tuple_t);
+bool tuple_first(pdns_tuple_ct);
+void tuple_first_fini(void);
 int data_blob(query_t, const char *, size_t);
 
 /* Any HTTP status codes we handle specifically */
 #define HTTP_OK		   200
+#define HTTP_TOO_MANY_REQUESTS 429
+#define HTTP_SERVICE_UNAVAILABLE 503
 
 #endif /*PDNS_H_INCLUDED*/
@@ -25,6 +25,7 @@
 #include "defs.h"
 #include "pdns.h"
 #include "pdns_dnsdb.h"
+#include "endpoint.h"
 #include "time.h"
 #include "globals.h"
 
@@ -33,9 +34,11 @@
 static const char *dnsdb_setval(const char *, const char *);
 static const char *dnsdb_ready(void);
 static void dnsdb_destroy(void);
-static char *dnsdb_url(const char *, char *, qdesc_ct, pdns_fence_ct);
+static char *dnsdb_url(const char *, const char *, char *,
+		       qdesc_ct, pdns_fence_ct);
 static void dnsdb_auth(fetch_t);
 static const char *dnsdb_status(fetch_t);
+static char *dnsdb_quota_url(const char *);
 
 /* variables. */
 
@@ -61,7 +64,7 @@ static const char *blocked_api_key_prefixes[] = {
 static const struct pdns_system dnsdb2 = {
 	"dnsdb2", "https://api.dnsdb.info/dnsdb/v2",
 	dnsdb_url, dnsdb_auth, dnsdb_status, dnsdb_setval,
-	dnsdb_ready, dnsdb_destroy
+	dnsdb_ready, dnsdb_destroy, dnsdb_quota_url
 };
 
 pdns_system_ct
@@ -105,7 +108,7 @@ dnsdb_setval(const char *key, const char *value) {
  */
 static const char *
 dnsdb_ready(void) {
-	const char *value;
+	const char *value, *msg;
 
 	if ((value = getenv(env_api_key)) != NULL) {
 		dnsdb_setval("apikey", value);
@@ -119,18 +122,12 @@ dnsdb_ready(void) {
 	if (dnsdb_base_url == NULL)
 		dnsdb_base_url = strdup(psys->base_url);
 
-	/* If SAF (aka APIv2) ensure URL contains special /dnsdb/v2 prefix. */
-	if (strstr(dnsdb_base_url, dnsdb2_url_prefix) == NULL) {
-		int x;
-		char *ret;
-		x = asprintf(&ret, "%s%s", dnsdb_base_url, dnsdb2_url_prefix);
-		if (x < 0) {
-			perror("asprintf");
-			abort();
-		}
-		DESTROY(dnsdb_base_url);
-		dnsdb_base_url = ret;
-	}
+	/* the server may be a list; each gets the /dnsdb/v2 prefix
+	 * (SAF, aka APIv2) if it does not have it.
+	 */
+	msg = endpoints_parse(dnsdb_base_url, dnsdb2_url_prefix);
+	if (msg != NULL)
+		return msg;
 
 	if (api_key == NULL)
 		return "no API key given";
@@ -149,6 +146,7 @@ static void
 dnsdb_destroy(void) {
 	DESTROY(api_key);
 	DESTROY(dnsdb_base_url);
+	endpoints_free();
 }
 
 /* dnsdb_url -- create a URL corresponding to a command-path string.
@@ -160,7 +158,9 @@ dnsdb_destroy(void) {
  * returns a string that must be freed.
  */
 static char *
-dnsdb_url(const char *path, char *sep, qdesc_ct qdp, pdns_fence_ct fp) {
+dnsdb_url(const char *base, const char *path, char *sep,
+	  qdesc_ct qdp, pdns_fence_ct fp)
+{
 	const char *p, *scheme_if_needed;
 	char *ret = NULL, *offset_str = NULL,
 		*first_after_str = NULL, *first_before_str = NULL,
@@ -175,12 +175,12 @@ dnsdb_url(const char *path, char *sep, qdesc_ct qdp, pdns_fence_ct fp) {
 	 * include its own verb. (this is from an old python-era rule.)
 	 */
 	x = 0;
-	for (p = dnsdb_base_url; *p != '\0'; p++)
+	for (p = base; *p != '\0'; p++)
 		x += (*p == '/');
 
 	/* supply a scheme if the server string did not. */
 	scheme_if_needed = "";
-	if (strstr(dnsdb_base_url, "://") == NULL)
+	if (strstr(base, "://") == NULL)
 		scheme_if_needed = "https://";
 
 	if (qdp->offset > 0) {
@@ -242,7 +242,7 @@ dnsdb_url(const char *path, char *sep, qdesc_ct qdp, pdns_fence_ct fp) {
 	}
 
 	x = asprintf(&ret, "%s%s/%s?swclient=%s&version=%s%s%s%s%s%s%s%s",
-		     scheme_if_needed, dnsdb_base_url, path,
+		     scheme_if_needed, base, path,
 		     id_swclient, id_version, 
 		     or_else(offset_str, ""),
 		     or_else(query_limit_str, ""),
@@ -290,3 +290,17 @@ dnsdb_status(fetch_t fetch __attribute__ ((unused))) {
 }
 
 #endif /*WANT_PDNS_DNSDB || WANT_PDNS_DNSDB2*/
+
+/* dnsdb_quota_url -- create the URL of the rate_limit report, which says
+ * how many queries the API key has left and when that is reset.
+ */
+static char *
+dnsdb_quota_url(const char *base) {
+	char *ret = NULL;
+
+	if (asprintf(&ret, "%s%s/rate_limit?swclient=%s&version=%s",
+		     strstr(base, "://") == NULL ? "https://" : "",
+		     base, id_swclient, id_version) < 0)
+		my_panic(true, "asprintf");
+	return ret;
+}
@@ -0,0 +1,290 @@
+/*
+ * Copyright (c) 2014-2020 by Farsight Security, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <jansson.h>
+
+#include "defs.h"
+#include "netio.h"
+#include "pdns.h"
+#include "exhaustive.h"
+#include "plan.h"
+#include "globals.h"
+
+static const char *load_string(json_t *, const char *, char **);
+static const char *load_long(json_t *, const char *, long *);
+static const char *load_fence(json_t *, qdesc_t);
+static void describe(json_t *, qdesc_ct, const char *, u_long, u_long);
+
+/* the names of the search parameters in a shard descriptor. */
+static const char * const method_names[] = {
+	[method_none] = NULL, [method_regex] = "regex", [method_glob] = "glob"
+};
+static const char * const search_names[] = {
+	[search_none] = NULL, [search_rrnames] = "rrnames",
+	[search_rdata] = "rdata"
+};
+static const char * const mode_names[] = {
+	[return_none] = NULL, [return_terse] = "terse",
+	[return_details] = "details"
+};
+
+/* plan_emit -- print one self-contained shard descriptor per line: for
+ * each rrtype (or just the query's), each --shard part (or just the
+ * query), and each of nwindows equal time windows.
+ *
+ * with more than one window the range defaults as for --exhaustive, and
+ * windows overlap-match, so results spanning a window edge come from
+ * both of its shards; --input with --dedup merges the outputs.
+ *
+ * est_cost is the shard's share of the whole plan.  nothing is known of
+ * where the results lie until they are fetched, so it is only each
+ * window's share of the time range, divided evenly among the rest.
+ */
+void
+plan_emit(qdesc_ct qdp, const struct qdesc *parts, size_t nparts,
+	  char * const *types, size_t ntypes, long nwindows)
+{
+	u_long after = qdp->after, before = qdp->before, width;
+	size_t total, t, p, id = 0;
+	long w;
+
+	/* main() has checked that the range is not empty. */
+	if (nwindows > 1 && !exhaustive_range(qdp, &after, &before))
+		return;
+	width = before - after;
+	total = (ntypes != 0 ? ntypes : 1) * nparts * (size_t)nwindows;
+	for (t = 0; t < (ntypes != 0 ? ntypes : 1); t++)
+	for (p = 0; p < nparts; p++)
+	for (w = 0; w < nwindows; w++) {
+		u_long lo = after, hi = before;
+		json_t *obj;
+		char idstr[sizeof "18446744073709551615/18446744073709551615"];
+		double cost = 1.0 / (double)(total / (size_t)nwindows);
+
+		if (nwindows > 1) {
+			lo = after + width * (u_long)w / (u_long)nwindows;
+			hi = after + width * (u_long)(w + 1) / (u_long)nwindows;
+			cost *= (double)(hi - lo) / (double)width;
+		}
+		snprintf(idstr, sizeof idstr, "%zu/%zu", ++id, total);
+		obj = json_object();
+		json_object_set_new(obj, "id", json_string(idstr));
+		describe(obj, &parts[p], (ntypes != 0) ? types[t] : NULL,
+			 lo, hi);
+		json_object_set_new(obj, "est_cost", json_real(cost));
+		json_dumpf(obj, stdout, JSON_INDENT(0) | JSON_COMPACT |
+			   JSON_REAL_PRECISION(6));
+		putchar('\n');
+		json_decref(obj);
+	}
+}
+
+/* plan_print -- write one query as a descriptor line, as --batch reads.
+ */
+void
+plan_print(FILE *f, qdesc_ct qdp) {
+	json_t *obj = json_object();
+
+	describe(obj, qdp, NULL, qdp->after, qdp->before);
+
+	json_dumpf(obj, f, JSON_INDENT(0) | JSON_COMPACT);
+	fputc('\n', f);
+	json_decref(obj);
+}
+
+/* describe -- fill in the JSON descriptor of a query, optionally with
+ * another rrtype, and with its own time window.
+ */
+static void
+describe(json_t *obj, qdesc_ct part, const char *rrtype,
+	 u_long lo, u_long hi)
+{
+	json_t *fence = json_object();
+
+	json_object_set_new(obj, "method", json_string(
+		method_names[part->search_method]));
+	json_object_set_new(obj, "search", json_string(
+		search_names[part->what_to_search]));
+	json_object_set_new(obj, "mode", json_string(
+		mode_names[part->mode_to_return]));
+	json_object_set_new(obj, "value", json_string(part->value));
+	if (part->exclude != NULL)
+		json_object_set_new(obj, "exclude",
+				    json_string(part->exclude));
+	if (rrtype != NULL)
+		json_object_set_new(obj, "rrtype", json_string(rrtype));
+	else if (part->rrtype != NULL)
+		json_object_set_new(obj, "rrtype",
+				    json_string(part->rrtype));
+	/* the same fence query_launcher() would make. */
+	if (lo != 0)
+		json_object_set_new(fence, part->complete ?
+				    "first_after" : "last_after",
+				    json_integer((json_int_t)lo));
+	if (hi != 0)
+		json_object_set_new(fence, part->complete ?
+				    "last_before" : "first_before",
+				    json_integer((json_int_t)hi));
+	json_object_set_new(obj, "fence", fence);
+	if (part->offset != 0)
+		json_object_set_new(obj, "offset",
+				    json_integer(part->offset));
+	if (part->query_limit != -1)
+		json_object_set_new(obj, "query_limit",
+				    json_integer(part->query_limit));
+	if (part->output_limit != -1)
+		json_object_set_new(obj, "output_limit",
+				    json_integer(part->output_limit));
+}
+
+/* plan_load -- fill in a query descriptor from a shard descriptor given
+ * as JSON text, or as the name of a file holding it ("-" for stdin).
+ *
+ * returns NULL on success, else an error message.
+ */
+const char *
+plan_load(const char *arg, qdesc_t qdp) {
+	const char *msg = NULL;
+	json_error_t error;
+	char *method = NULL, *search = NULL, *mode = NULL;
+	json_t *obj;
+
+	if (arg[0] == '{') {
+		obj = json_loads(arg, 0, &error);
+	} else {
+		FILE *f = (strcmp(arg, "-") == 0) ? stdin : fopen(arg, "r");
+
+		if (f == NULL)
+			return "cannot read the descriptor";
+		obj = json_loadf(f, JSON_DISABLE_EOF_CHECK, &error);
+		if (f != stdin)
+			fclose(f);
+	}
+	if (!json_is_object(obj)) {
+		json_decref(obj);
+		return "the descriptor is not a JSON object";
+	}
+
+	if ((msg = load_string(obj, "method", &method)) != NULL ||
+	    (msg = load_string(obj, "search", &search)) != NULL ||
+	    (msg = load_string(obj, "mode", &mode)) != NULL ||
+	    (msg = load_string(obj, "value", &qdp->value)) != NULL ||
+	    (msg = load_string(obj, "exclude", &qdp->exclude)) != NULL ||
+	    (msg = load_string(obj, "rrtype", &qdp->rrtype)) != NULL ||
+	    (msg = load_long(obj, "offset", &qdp->offset)) != NULL ||
+	    (msg = load_long(obj, "query_limit", &qdp->query_limit)) != NULL ||
+	    (msg = load_long(obj, "output_limit", &qdp->output_limit))
+	    != NULL ||
+	    (msg = load_fence(json_object_get(obj, "fence"), qdp)) != NULL)
+		goto done;
+
+	if (method == NULL || qdp->value == NULL) {
+		msg = "the descriptor needs a method and a value";
+		goto done;
+	}
+	if (strcmp(method, "glob") == 0)
+		qdp->search_method = method_glob;
+	else if (strcmp(method, "regex") == 0)
+		qdp->search_method = method_regex;
+	else
+		msg = "method must be glob or regex";
+	if (search != NULL) {
+		if (strcmp(search, "rrnames") == 0)
+			qdp->what_to_search = search_rrnames;
+		else if (strcmp(search, "rdata") == 0)
+			qdp->what_to_search = search_rdata;
+		else
+			msg = "search must be rrnames or rdata";
+	}
+	if (mode != NULL) {
+		if (strcmp(mode, "terse") == 0)
+			qdp->mode_to_return = return_terse;
+		else if (strcmp(mode, "details") == 0)
+			qdp->mode_to_return = return_details;
+		else
+			msg = "mode must be terse or details";
+	}
+ done:
+	DESTROY(method);
+	DESTROY(search);
+	DESTROY(mode);
+	json_decref(obj);
+	return msg;
+}
+
+/* load_string -- copy an optional string member.
+ */
+static const char *
+load_string(json_t *obj, const char *key, char **dst) {
+	json_t *val = json_object_get(obj, key);
+
+	if (val == NULL)
+		return NULL;
+	if (!json_is_string(val))
+		return "a descriptor member is not a string";
+	DESTROY(*dst);
+	*dst = strdup(json_string_value(val));
+	return NULL;
+}
+
+/* load_long -- copy an optional integer member.
+ */
+static const char *
+load_long(json_t *obj, const char *key, long *dst) {
+	json_t *val = json_object_get(obj, key);
+
+	if (val == NULL)
+		return NULL;
+	if (!json_is_integer(val))
+		return "a descriptor member is not an integer";
+	*dst = (long)json_integer_value(val);
+	return NULL;
+}
+
+/* load_fence -- turn a pdns_fence back into -A, -B, and -c.
+ *
+ * query_launcher() makes last_after and first_before from -A and -B, or
+ * with -c first_after and last_before; a mix of the two cannot be asked
+ * for.
+ */
+static const char *
+load_fence(json_t *fence, qdesc_t qdp) {
+	static const char * const keys[] = {
+		"last_after", "first_before", "first_after", "last_before"
+	};
+	long vals[4] = { 0, 0, 0, 0 };
+	const char *msg;
+	int i;
+
+	if (fence == NULL)
+		return NULL;
+	if (!json_is_object(fence))
+		return "fence is not an object";
+	for (i = 0; i < 4; i++)
+		if ((msg = load_long(fence, keys[i], &vals[i])) != NULL)
+			return msg;
+	if ((vals[0] != 0 || vals[1] != 0) && (vals[2] != 0 || vals[3] != 0))
+		return "a fence cannot mix complete and"
+			" overlapping time matching";
+	qdp->complete = (vals[2] != 0 || vals[3] != 0);
+	qdp->after = (u_long)(qdp->complete ? vals[2] : vals[0]);
+	qdp->before = (u_long)(qdp->complete ? vals[3] : vals[1]);
+	return NULL;
+}
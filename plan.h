@@ -0,0 +1,30 @@
+/*
+ * Copyright (c) 2014-2020 by Farsight Security, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PLAN_H_INCLUDED
+#define PLAN_H_INCLUDED 1
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "netio.h"
+
+void plan_emit(qdesc_ct, const struct qdesc *, size_t,
+	       char * const *, size_t, long);
+void plan_print(FILE *, qdesc_ct);
+const char *plan_load(const char *, qdesc_t);
+
+#endif /*PLAN_H_INCLUDED*/
@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2014-2020 by Farsight Security, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <dlfcn.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "defs.h"
+#include "pdns.h"
+#include "dnsdbflex_plugin.h"
+#include "plugin.h"
+#include "sink.h"
+#include "globals.h"
+
+static int plugin_write(void *, const void *, size_t);
+static void plugin_start(sink_t);
+
+static void *handle = NULL;
+static const struct dnsdbflex_plugin *plugin = NULL;
+static const char *plugin_arg = NULL;
+static void *plugin_state = NULL;
+static struct dnsdbflex_output plugin_output;
+static bool started = false;
+
+/* plugin_load -- dlopen a presenter plugin and check its ABI version.
+ *
+ * returns NULL if ok, else an error message.
+ */
+const char *
+plugin_load(const char *path, const char *arg) {
+	dnsdbflex_plugin_entry_t entry;
+	void *sym;
+
+	handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+	if (handle == NULL)
+		return dlerror();
+	sym = dlsym(handle, DNSDBFLEX_PLUGIN_ENTRY);
+	if (sym == NULL)
+		return "--presenter-plugin: no " DNSDBFLEX_PLUGIN_ENTRY
+			" entry point; built for another ABI version?";
+	entry = (dnsdbflex_plugin_entry_t)sym;
+	plugin = (*entry)();
+	if (plugin == NULL || plugin->abi != DNSDBFLEX_PLUGIN_ABI)
+		return "--presenter-plugin: plugin ABI version mismatch";
+	if (plugin->present == NULL)
+		return "--presenter-plugin: plugin has no present function";
+	plugin_arg = arg;
+	return NULL;
+}
+
+/* present_plugin -- hand one tuple to the plugin as a dnsdbflex_tuple.
+ */
+void
+present_plugin(pdns_tuple_ct tup, const char *jsonbuf, size_t jsonlen,
+	       sink_t sink)
+{
+	struct dnsdbflex_tuple view = {
+		.size = sizeof view,
+		.rrname = tup->rrname,
+		.rrtype = tup->rrtype,
+		.rdata = tup->rdata,
+		.raw_rdata = tup->raw_rdata,
+		.has_count = tup->obj.count != NULL,
+		.has_time_first = tup->obj.time_first != NULL,
+		.has_time_last = tup->obj.time_last != NULL,
+		.count = tup->count,
+		.time_first = tup->time_first,
+		.time_last = tup->time_last,
+		.json = jsonbuf,
+		.jsonlen = jsonlen,
+	};
+
+	if (!started)
+		plugin_start(sink);
+	if ((*plugin->present)(plugin_state, &view, &plugin_output) != 0) {
+		my_logf("--presenter-plugin: %s: present failed",
+			plugin->name);
+		my_exit(1);
+	}
+}
+
+/* plugin_fini -- let the plugin finish its output.
+ */
+void
+plugin_fini(sink_t sink) {
+	if (!started)
+		plugin_start(sink);
+	if (plugin->fini != NULL &&
+	    (*plugin->fini)(plugin_state, &plugin_output) != 0)
+	{
+		my_logf("--presenter-plugin: %s: fini failed", plugin->name);
+		my_exit(1);
+	}
+	plugin_state = NULL;
+	started = false;
+}
+
+/* plugin_unload -- dlclose the plugin, once its output is finished.
+ */
+void
+plugin_unload(void) {
+	if (handle != NULL)
+		dlclose(handle);
+	handle = NULL;
+	plugin = NULL;
+}
+
+/* plugin_start -- bind the plugin's output to a sink and call its init.
+ */
+static void
+plugin_start(sink_t sink) {
+	plugin_output.handle = sink->out;
+	plugin_output.write = plugin_write;
+	if (plugin->init != NULL &&
+	    (*plugin->init)(&plugin_state, plugin_arg, &plugin_output) != 0)
+	{
+		my_logf("--presenter-plugin: %s: init failed", plugin->name);
+		my_exit(1);
+	}
+	started = true;
+}
+
+/* plugin_write -- the write function handed to the plugin.
+ */
+static int
+plugin_write(void *out, const void *buf, size_t len) {
+	return (fwrite(buf, 1, len, out) == len) ? 0 : -1;
+}
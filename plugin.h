@@ -0,0 +1,28 @@
+/*
+ * Copyright (c) 2014-2020 by Farsight Security, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef PLUGIN_H_INCLUDED
+#define PLUGIN_H_INCLUDED 1
+
+#include "pdns.h"
+
+const char *plugin_load(const char *, const char *);
+void present_plugin(pdns_tuple_ct, const char *, size_t, sink_t);
+void plugin_fini(sink_t);
+void plugin_unload(void);
+
+#endif /*PLUGIN_H_INCLUDED*/
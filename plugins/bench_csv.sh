@@ -0,0 +1,40 @@
+#! /bin/sh
+#
+# compare the csv presenter plugin with the equivalent jq pipeline.
+#
+# usage: plugins/bench_csv.sh DNSDBFLEX-ARGUMENTS...
+# e.g.:  plugins/bench_csv.sh --glob '*.example.com.' -l 100000
+#
+# the query is run once each way, so it costs two queries of quota.
+# run "make plugins" first.  both outputs are checked to be identical.
+#
+dir=`dirname $0`
+flex=${DNSDBFLEX:-$dir/../dnsdbflex}
+tmp=${TMPDIR:-/tmp}/bench_csv.$$
+trap 'rm -f $tmp.*' 0
+
+elapsed() {
+	start=`date +%s.%N`
+	"$@"
+	end=`date +%s.%N`
+	awk "BEGIN { printf \"%.3f\", $end - $start }"
+}
+
+pipeline() {
+	$flex -q "$@" -j | jq -r '[.rrname // .rdata, .rrtype] | @csv' > $tmp.jq
+}
+
+plugin() {
+	$flex -q "$@" --presenter-plugin $dir/csv.so > $tmp.plugin
+}
+
+t_jq=`elapsed pipeline "$@"`
+t_plugin=`elapsed plugin "$@"`
+# the plugin adds a header line, which the pipeline does not.
+if ! tail -n +2 $tmp.plugin | cmp -s $tmp.jq -; then
+	echo "outputs differ" >&2
+	exit 1
+fi
+echo "`wc -l < $tmp.jq` results"
+echo "jq pipeline:  $t_jq s"
+echo "csv plugin:   $t_plugin s"
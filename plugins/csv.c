@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2014-2020 by Farsight Security, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/* csv -- sample dnsdbflex presenter plugin writing CSV.
+ *
+ * the output has a header line naming the columns, then one line per
+ * result holding its rrname (or rdata, for rdata searches) and rrtype,
+ * each quoted as jq's @csv does.  it is the in-process equivalent of
+ *	dnsdbflex ... -j | jq -r '[.rrname, .rrtype] | @csv'
+ * as plugins/bench_csv.sh measures.  --plugin-arg is ignored.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "dnsdbflex_plugin.h"
+
+/* longer results are written in pieces. */
+#define CSV_LINE_MAX 4096
+
+struct csv {
+	bool		 header_done;
+	char		 line[CSV_LINE_MAX];
+	size_t		 len;
+};
+
+static int csv_init(void **, const char *, const struct dnsdbflex_output *);
+static int csv_present(void *, const struct dnsdbflex_tuple *,
+		       const struct dnsdbflex_output *);
+static int csv_fini(void *, const struct dnsdbflex_output *);
+static int csv_put(struct csv *, const struct dnsdbflex_output *,
+		   const char *, size_t);
+static int csv_quoted(struct csv *, const struct dnsdbflex_output *,
+		      const char *);
+
+static const struct dnsdbflex_plugin csv_plugin = {
+	.abi = DNSDBFLEX_PLUGIN_ABI,
+	.name = "csv",
+	.init = csv_init,
+	.present = csv_present,
+	.fini = csv_fini,
+};
+
+const struct dnsdbflex_plugin *
+dnsdbflex_plugin_v1(void) {
+	return &csv_plugin;
+}
+
+static int
+csv_init(void **state, const char *arg __attribute__ ((unused)),
+	 const struct dnsdbflex_output *out __attribute__ ((unused)))
+{
+	*state = calloc(1, sizeof(struct csv));
+	return (*state == NULL) ? -1 : 0;
+}
+
+static int
+csv_present(void *state, const struct dnsdbflex_tuple *tup,
+	    const struct dnsdbflex_output *out)
+{
+	struct csv *csv = state;
+	const char *name = (tup->rrname != NULL) ? tup->rrname : tup->rdata;
+
+	if (!csv->header_done) {
+		const char *hdr = (tup->rrname != NULL)
+			? "rrname,rrtype\n" : "rdata,rrtype\n";
+
+		if (csv_put(csv, out, hdr, strlen(hdr)) != 0)
+			return -1;
+		csv->header_done = true;
+	}
+	if (csv_quoted(csv, out, name) != 0 ||
+	    csv_put(csv, out, ",", 1) != 0 ||
+	    csv_quoted(csv, out, tup->rrtype) != 0 ||
+	    csv_put(csv, out, "\n", 1) != 0)
+		return -1;
+	/* hand over whole lines, so the host's buffering decides writes. */
+	if (out->write(out->handle, csv->line, csv->len) != 0)
+		return -1;
+	csv->len = 0;
+	return 0;
+}
+
+static int
+csv_fini(void *state, const struct dnsdbflex_output *out) {
+	struct csv *csv = state;
+	int ret = 0;
+
+	if (csv->len != 0)
+		ret = out->write(out->handle, csv->line, csv->len);
+	free(csv);
+	return ret;
+}
+
+/* csv_put -- add bytes to the line, writing it out if it fills up.
+ */
+static int
+csv_put(struct csv *csv, const struct dnsdbflex_output *out,
+	const char *buf, size_t len)
+{
+	while (len > 0) {
+		size_t n = sizeof csv->line - csv->len;
+
+		if (n == 0) {
+			if (out->write(out->handle, csv->line, csv->len) != 0)
+				return -1;
+			csv->len = 0;
+			continue;
+		}
+		if (n > len)
+			n = len;
+		memcpy(csv->line + csv->len, buf, n);
+		csv->len += n;
+		buf += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/* csv_quoted -- add a string in double quotes, doubling any within it;
+ * a missing string is an empty field.
+ */
+static int
+csv_quoted(struct csv *csv, const struct dnsdbflex_output *out,
+	   const char *str)
+{
+	const char *quote;
+
+	if (str == NULL)
+		return 0;
+	if (csv_put(csv, out, "\"", 1) != 0)
+		return -1;
+	while ((quote = strchr(str, '"')) != NULL) {
+		if (csv_put(csv, out, str, (size_t)(quote - str) + 1) != 0 ||
+		    csv_put(csv, out, "\"", 1) != 0)
+			return -1;
+		str = quote + 1;
+	}
+	if (csv_put(csv, out, str, strlen(str)) != 0)
+		return -1;
+	return csv_put(csv, out, "\"", 1);
+}
@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2014-2020 by Farsight Security, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <limits.h>
+#include <string.h>
+
+#include <jansson.h>
+
+#include "defs.h"
+#include "netio.h"
+#include "pdns.h"
+#include "aimd.h"
+#include "endpoint.h"
+#include "time.h"
+#include "quota.h"
+#include "globals.h"
+
+static size_t quota_writer(char *, size_t, size_t, void *);
+static const char *quota_parse(const char *, size_t);
+static long rate_value(const json_t *, const char *);
+
+/* what the server said is left of the quota; -1 where it said nothing
+ * or there is no limit.
+ */
+static long limit = -1L, remaining = -1L, reset = -1L, burst = -1L;
+/* queries made since, and whether running out stops more. */
+static long used = 0L;
+static bool enforced = true;
+
+struct report {
+	char	*buf;
+	size_t	 len;
+};
+
+/* quota_load -- ask the server what is left of the API key's quota,
+ * through the same endpoint and authentication as any query.  if that
+ * cannot be learned, the run goes on as if there were no quota.
+ */
+void
+quota_load(void) {
+	struct fetch fetch = {};
+	struct report report = {};
+	const char *msg = NULL;
+	endpoint_t endpoint;
+	CURLcode res;
+
+	if (psys->quota_url == NULL)
+		return;
+	endpoint = endpoint_pick(NULL);
+	fetch.url = psys->quota_url(endpoint->base);
+	DEBUG(1, true, "quota url [%s]\n", fetch.url);
+	fetch.easy = curl_easy_init();
+	if (fetch.easy == NULL)
+		my_panic(false, "curl_easy_init");
+	curl_easy_setopt(fetch.easy, CURLOPT_URL, fetch.url);
+	if (donotverify) {
+		curl_easy_setopt(fetch.easy, CURLOPT_SSL_VERIFYPEER, 0L);
+		curl_easy_setopt(fetch.easy, CURLOPT_SSL_VERIFYHOST, 0L);
+	}
+	if (curl_ipresolve != CURL_IPRESOLVE_WHATEVER)
+		curl_easy_setopt(fetch.easy,
+				 CURLOPT_IPRESOLVE, curl_ipresolve);
+	curl_easy_setopt(fetch.easy, CURLOPT_TIMEOUT,
+			 (curl_timeout != 0L) ? curl_timeout : QUOTA_TIMEOUT);
+	if (psys->auth != NULL)
+		psys->auth(&fetch);
+	fetch.hdrs = curl_slist_append(fetch.hdrs,
+				       "Accept: application/json");
+	curl_easy_setopt(fetch.easy, CURLOPT_HTTPHEADER, fetch.hdrs);
+	curl_easy_setopt(fetch.easy, CURLOPT_WRITEFUNCTION, quota_writer);
+	curl_easy_setopt(fetch.easy, CURLOPT_WRITEDATA, &report);
+
+	res = curl_easy_perform(fetch.easy);
+	if (res == CURLE_OK)
+		curl_easy_getinfo(fetch.easy, CURLINFO_RESPONSE_CODE,
+				  &fetch.rcode);
+	if (res != CURLE_OK)
+		msg = curl_easy_strerror(res);
+	else if (fetch.rcode != HTTP_OK)
+		msg = "the server did not report it";
+	else
+		msg = quota_parse(report.buf, report.len);
+	if (msg != NULL && !quiet)
+		my_logf("warning: cannot learn the quota: %s", msg);
+
+	/* a burst allowance bounds how many queries can be in flight. */
+	if (burst > 0L)
+		aimd_limit((size_t)burst);
+
+	curl_slist_free_all(fetch.hdrs);
+	curl_easy_cleanup(fetch.easy);
+	DESTROY(fetch.url);
+	DESTROY(report.buf);
+}
+
+/* quota_fits -- say what a run of need queries (or at_least that many)
+ * will use of the quota, and whether that fits in what is left.
+ */
+bool
+quota_fits(size_t need, bool at_least, const char *what) {
+	if (remaining < 0L)
+		return true;
+	if (!quiet) {
+		if (reset > 0L)
+			my_logf("%s: %s%zu query(ies) planned; %ld of %ld"
+				" left in the quota until %s", what,
+				at_least ? "at least " : "", need,
+				remaining, limit, time_str((u_long)reset));
+		else
+			my_logf("%s: %s%zu query(ies) planned; %ld of %ld"
+				" left in the quota", what,
+				at_least ? "at least " : "", need,
+				remaining, limit);
+	}
+	return need <= (size_t)remaining;
+}
+
+/* quota_waive -- let the run go on past the end of the quota.
+ */
+void
+quota_waive(void) {
+	enforced = false;
+}
+
+/* quota_left -- how many more queries the quota allows; LONG_MAX if it
+ * is unknown, unlimited, or waived.
+ */
+long
+quota_left(void) {
+	if (remaining < 0L || !enforced)
+		return LONG_MAX;
+	return remaining - used;
+}
+
+/* quota_spend -- count one query against the quota.
+ */
+void
+quota_spend(void) {
+	used++;
+}
+
+/* quota_report -- say what the run used of a known quota.
+ */
+void
+quota_report(void) {
+	if (remaining < 0L || quiet)
+		return;
+	my_logf("quota: %ld query(ies) used, about %ld left", used,
+		(remaining > used) ? remaining - used : 0L);
+}
+
+/* quota_writer -- gather the quota report.
+ *
+ * This function's signature must conform to write_callback() in
+ * CURLOPT_WRITEFUNCTION.
+ */
+static size_t
+quota_writer(char *ptr, size_t size, size_t nmemb, void *blob) {
+	struct report *report = blob;
+	size_t bytes = size * nmemb;
+
+	report->buf = realloc(report->buf, report->len + bytes + 1);
+	if (report->buf == NULL)
+		my_panic(true, "realloc");
+	memcpy(report->buf + report->len, ptr, bytes);
+	report->len += bytes;
+	report->buf[report->len] = '\0';
+	return bytes;
+}
+
+/* quota_parse -- pick the quota out of a rate_limit report, e.g.
+ * {"rate":{"reset":1433980800,"limit":1000,"remaining":999}}, where any
+ * value may instead be "n/a" or "unlimited".
+ *
+ * returns NULL on success, else an error message.
+ */
+static const char *
+quota_parse(const char *buf, size_t len) {
+	json_error_t error;
+	json_t *obj, *rate;
+
+	if (buf == NULL)
+		return "the report was empty";
+	obj = json_loadb(buf, len, 0, &error);
+	if (obj == NULL)
+		return "the report is not JSON";
+	rate = json_object_get(obj, "rate");
+	if (!json_is_object(rate)) {
+		json_decref(obj);
+		return "the report has no \"rate\"";
+	}
+	limit = rate_value(rate, "limit");
+	remaining = rate_value(rate, "remaining");
+	reset = rate_value(rate, "reset");
+	burst = rate_value(rate, "burst_size");
+	DEBUG(1, true, "quota limit %ld remaining %ld reset %ld burst %ld\n",
+	      limit, remaining, reset, burst);
+	json_decref(obj);
+	return NULL;
+}
+
+/* rate_value -- one number from a rate_limit report, or -1.
+ */
+static long
+rate_value(const json_t *rate, const char *key) {
+	const json_t *val = json_object_get(rate, key);
+
+	if (!json_is_integer(val) || json_integer_value(val) < 0)
+		return -1L;
+	return (long)json_integer_value(val);
+}
@@ -0,0 +1,35 @@
+/*
+ * Copyright (c) 2014-2020 by Farsight Security, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef QUOTA_H_INCLUDED
+#define QUOTA_H_INCLUDED 1
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* the quota report is given this long to answer, in seconds, unless
+ * --timeout says otherwise.
+ */
+#define QUOTA_TIMEOUT 10L
+
+void quota_load(void);
+bool quota_fits(size_t, bool, const char *);
+void quota_waive(void);
+long quota_left(void);
+void quota_spend(void);
+void quota_report(void);
+
+#endif /*QUOTA_H_INCLUDED*/
@@ -0,0 +1,855 @@
+/*
+ * Copyright (c) 2014-2020 by Farsight Security, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* All patterns are compiled (Thompson style) into one NFA.  A DFA over
+ * that NFA is built lazily, one state and one transition at a time, as
+ * subjects are matched; each DFA state knows which patterns it accepts.
+ * Matching is thus one table lookup per subject byte however many
+ * patterns there are.  If the DFA grows past DFA_MAX_STATES it is
+ * discarded and rebuilt on demand.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "defs.h"
+#include "pdns.h"
+#include "hash.h"
+#include "regset.h"
+#include "globals.h"
+
+#define DFA_MAX_STATES 4096
+#define MAX_REPEAT 255
+#define SYM_EOL 256		/* the end-of-subject symbol, for $ */
+#define NSYMS 257
+
+/* abstract syntax tree of one pattern. */
+typedef enum { ast_set, ast_cat, ast_alt, ast_star, ast_plus, ast_quest,
+	       ast_eol, ast_empty } ast_e;
+
+struct ast {
+	ast_e		 kind;
+	int		 set;		/* ast_set: index of charset */
+	struct ast	*left, *right;
+};
+
+/* NFA states.  set states consume one byte in their charset, eol states
+ * consume the end-of-subject symbol, split states are epsilon forks, and
+ * match states accept one pattern.
+ */
+typedef enum { ns_set, ns_eol, ns_split, ns_match } nstate_e;
+
+struct nstate {
+	nstate_e	 kind;
+	int		 set;		/* ns_set: index of charset */
+	int		 out, out1;	/* successors, -1 if none */
+	size_t		 pattern;	/* ns_match: pattern number */
+};
+
+struct charset {
+	uint64_t	 bits[4];
+};
+
+struct dstate {
+	int		*nfa;		/* sorted NFA states, no splits */
+	size_t		 nnfa;
+	size_t		*matches;	/* patterns accepted here */
+	size_t		 nmatches;
+	int		 next[NSYMS];	/* -1 until computed */
+};
+
+/* a pattern is entered at start at the beginning of the subject, and at
+ * floating (its branches not anchored with ^, -1 if none) after that.
+ */
+struct pattern {
+	char		*id;
+	int		 start, floating;
+};
+
+struct regset {
+	struct pattern	*patterns;
+	size_t		 npatterns;
+	struct nstate	*nstates;
+	size_t		 nnstates, maxnstates;
+	struct charset	*charsets;
+	size_t		 ncharsets, maxcharsets;
+	/* DFA. */
+	struct dstate	*dstates;
+	size_t		 ndstates, maxdstates;
+	hash_t		 dindex;
+	/* scratch. */
+	unsigned	*nstamp, gen;
+	int		*work;
+	size_t		*found;
+	unsigned	*pstamp, pgen;
+	bool		 dirty;
+};
+
+/* parser state for one pattern. */
+struct parse {
+	regset_t	 rs;
+	const char	*p;
+	const char	*err;
+	int		 depth;
+};
+
+static struct ast *parse_cat(struct parse *);
+static struct ast *parse_alt(struct parse *);
+static struct ast *ast_new(ast_e, struct ast *, struct ast *);
+static void ast_free(struct ast *);
+static int charset_new(regset_t);
+static int nstate_new(regset_t, nstate_e, int, int);
+static int compile(regset_t, const struct ast *, int);
+static void closure(regset_t, int, int *, size_t *);
+static int dstate_intern(regset_t, int *, size_t);
+static int dstate_step(regset_t, int, int);
+static void dfa_flush(regset_t);
+
+/* regset_new -- create an empty pattern set.
+ */
+regset_t
+regset_new(void) {
+	regset_t rs = NULL;
+
+	CREATE(rs, sizeof *rs);
+	rs->dindex = hash_new();
+	return rs;
+}
+
+/* regset_add -- parse and compile one pattern into the set.
+ *
+ * returns NULL if ok, otherwise a static error message.
+ */
+const char *
+regset_add(regset_t rs, const char *id, const char *pattern) {
+	struct parse ps = { rs, pattern, NULL, 0 };
+	struct ast *fixed = NULL, *loose = NULL;
+	struct pattern *pat;
+	int match, start;
+
+	/* each top-level branch may be anchored with ^ on its own. */
+	for (;;) {
+		struct ast **side = &loose, *branch;
+
+		if (*ps.p == '^') {
+			side = &fixed;
+			ps.p++;
+		}
+		branch = parse_cat(&ps);
+		*side = (*side == NULL) ? branch
+			: ast_new(ast_alt, *side, branch);
+		if (ps.err != NULL || *ps.p != '|')
+			break;
+		ps.p++;
+	}
+	if (ps.err == NULL && *ps.p != '\0')
+		ps.err = (*ps.p == ')') ? "unmatched )" : "syntax error";
+	if (ps.err != NULL) {
+		ast_free(fixed);
+		ast_free(loose);
+		return ps.err;
+	}
+
+	rs->patterns = realloc(rs->patterns,
+			       (rs->npatterns + 1) * sizeof *rs->patterns);
+	if (rs->patterns == NULL)
+		my_panic(true, "realloc");
+	pat = &rs->patterns[rs->npatterns];
+	pat->id = strdup(id);
+	match = nstate_new(rs, ns_match, -1, -1);
+	rs->nstates[match].pattern = rs->npatterns;
+	pat->floating = (loose != NULL) ? compile(rs, loose, match) : -1;
+	if (fixed != NULL) {
+		start = compile(rs, fixed, match);
+		if (pat->floating >= 0)
+			start = nstate_new(rs, ns_split, start, pat->floating);
+		pat->start = start;
+	} else {
+		pat->start = pat->floating;
+	}
+	ast_free(fixed);
+	ast_free(loose);
+	rs->npatterns++;
+	rs->dirty = true;
+	return NULL;
+}
+
+/* regset_count -- number of patterns in the set.
+ */
+size_t
+regset_count(const struct regset *rs) {
+	return rs->npatterns;
+}
+
+/* regset_id -- identifier given for one pattern.
+ */
+const char *
+regset_id(const struct regset *rs, size_t pattern) {
+	return rs->patterns[pattern].id;
+}
+
+/* regset_match -- find which patterns match somewhere in a subject.
+ *
+ * returns the number of patterns matched and points *which at their
+ * numbers, ascending, valid until the next call.
+ */
+size_t
+regset_match(regset_t rs, const char *subject, size_t len,
+	     const size_t **which)
+{
+	size_t nfound = 0, i;
+	int ds;
+
+	if (rs->dirty)
+		dfa_flush(rs);
+	if (++rs->pgen == 0) {
+		memset(rs->pstamp, 0, rs->npatterns * sizeof(unsigned));
+		rs->pgen = 1;
+	}
+	ds = 0;
+	for (i = 0; i <= len; i++) {
+		const struct dstate *d = &rs->dstates[ds];
+		size_t m;
+
+		for (m = 0; m < d->nmatches; m++)
+			if (rs->pstamp[d->matches[m]] != rs->pgen) {
+				rs->pstamp[d->matches[m]] = rs->pgen;
+				rs->found[nfound++] = d->matches[m];
+			}
+		if (nfound == rs->npatterns)
+			break;
+		int sym = (i < len) ? (uint8_t)subject[i] : SYM_EOL;
+		if (d->next[sym] < 0)
+			ds = dstate_step(rs, ds, sym);
+		else
+			ds = d->next[sym];
+		if (sym == SYM_EOL) {
+			d = &rs->dstates[ds];
+			for (m = 0; m < d->nmatches; m++)
+				if (rs->pstamp[d->matches[m]] != rs->pgen) {
+					rs->pstamp[d->matches[m]] = rs->pgen;
+					rs->found[nfound++] = d->matches[m];
+				}
+		}
+	}
+
+	/* insertion sort; there are rarely more than a few. */
+	for (i = 1; i < nfound; i++) {
+		size_t x = rs->found[i], j = i;
+
+		while (j > 0 && rs->found[j - 1] > x) {
+			rs->found[j] = rs->found[j - 1];
+			j--;
+		}
+		rs->found[j] = x;
+	}
+	*which = rs->found;
+	return nfound;
+}
+
+/* regset_destroy -- release a pattern set.
+ */
+void
+regset_destroy(regset_t rs) {
+	size_t i;
+
+	if (rs == NULL)
+		return;
+	for (i = 0; i < rs->ndstates; i++) {
+		DESTROY(rs->dstates[i].nfa);
+		DESTROY(rs->dstates[i].matches);
+	}
+	DESTROY(rs->dstates);
+	hash_destroy(rs->dindex, NULL);
+	for (i = 0; i < rs->npatterns; i++)
+		DESTROY(rs->patterns[i].id);
+	DESTROY(rs->patterns);
+	DESTROY(rs->nstates);
+	DESTROY(rs->charsets);
+	DESTROY(rs->nstamp);
+	DESTROY(rs->work);
+	DESTROY(rs->found);
+	DESTROY(rs->pstamp);
+	DESTROY(rs);
+}
+
+/*---------------------------------------------------------------- parsing
+ */
+
+static void
+set_add(struct charset *cs, int c) {
+	cs->bits[c >> 6] |= (uint64_t)1 << (c & 63);
+}
+
+static bool
+set_has(const struct charset *cs, int c) {
+	return (cs->bits[c >> 6] >> (c & 63)) & 1;
+}
+
+/* class_escape -- add the class named by \d, \w, \s or their negations.
+ *
+ * returns false if c does not name a class.
+ */
+static bool
+class_escape(struct charset *cs, int c) {
+	struct charset tmp = { { 0, 0, 0, 0 } };
+	int i;
+
+	switch (c) {
+	case 'd': case 'D':
+		for (i = '0'; i <= '9'; i++)
+			set_add(&tmp, i);
+		break;
+	case 'w': case 'W':
+		for (i = 0; i < 256; i++)
+			if ((i >= '0' && i <= '9') || (i >= 'a' && i <= 'z') ||
+			    (i >= 'A' && i <= 'Z') || i == '_')
+				set_add(&tmp, i);
+		break;
+	case 's': case 'S':
+		for (i = 0; i < 256; i++)
+			if (strchr(" \t\r\n\f\v", i) != NULL && i != 0)
+				set_add(&tmp, i);
+		break;
+	default:
+		return false;
+	}
+	for (i = 0; i < 4; i++)
+		cs->bits[i] |= (c >= 'A' && c <= 'Z')
+			? ~tmp.bits[i] : tmp.bits[i];
+	return true;
+}
+
+/* parse_class -- parse a bracket expression; ps->p is just past the [.
+ */
+static struct ast *
+parse_class(struct parse *ps) {
+	int set = charset_new(ps->rs);
+	struct charset cs = { { 0, 0, 0, 0 } };
+	bool negate = false, first = true;
+	int i;
+
+	if (*ps->p == '^') {
+		negate = true;
+		ps->p++;
+	}
+	while (*ps->p != '\0' && (*ps->p != ']' || first)) {
+		int lo = (uint8_t)*ps->p++, hi;
+
+		first = false;
+		if (lo == '\\' && *ps->p != '\0') {
+			if (class_escape(&cs, *ps->p)) {
+				ps->p++;
+				continue;
+			}
+			lo = (uint8_t)*ps->p++;
+		}
+		hi = lo;
+		if (ps->p[0] == '-' && ps->p[1] != ']' && ps->p[1] != '\0') {
+			ps->p++;
+			hi = (uint8_t)*ps->p++;
+			if (hi == '\\' && *ps->p != '\0')
+				hi = (uint8_t)*ps->p++;
+			if (hi < lo) {
+				ps->err = "bad range in []";
+				return NULL;
+			}
+		}
+		for (i = lo; i <= hi; i++)
+			set_add(&cs, i);
+	}
+	if (*ps->p != ']') {
+		ps->err = "unmatched [";
+		return NULL;
+	}
+	ps->p++;
+	if (negate)
+		for (i = 0; i < 4; i++)
+			cs.bits[i] = ~cs.bits[i];
+	ps->rs->charsets[set] = cs;
+
+	struct ast *ast = ast_new(ast_set, NULL, NULL);
+	ast->set = set;
+	return ast;
+}
+
+/* parse_atom -- parse one literal, class, dot, $, or group.
+ */
+static struct ast *
+parse_atom(struct parse *ps) {
+	struct ast *ast;
+	int set, c;
+
+	switch (c = (uint8_t)*ps->p++) {
+	case '(':
+		if (++ps->depth > 100) {
+			ps->err = "groups nested too deeply";
+			return NULL;
+		}
+		ast = parse_alt(ps);
+		ps->depth--;
+		if (ps->err == NULL && *ps->p++ != ')')
+			ps->err = "unmatched (";
+		return ast;
+	case '[':
+		return parse_class(ps);
+	case '$':
+		return ast_new(ast_eol, NULL, NULL);
+	case '^':
+		ps->err = "^ is only allowed at the start of a pattern"
+			" or of one of its alternatives";
+		return NULL;
+	case '*': case '+': case '?': case '{':
+		ps->err = "repetition operator without an operand";
+		return NULL;
+	}
+
+	set = charset_new(ps->rs);
+	if (c == '.') {
+		memset(&ps->rs->charsets[set], 0xff, sizeof(struct charset));
+	} else if (c == '\\') {
+		c = (uint8_t)*ps->p++;
+		if (c == '\0') {
+			ps->p--;
+			ps->err = "trailing \\";
+			return NULL;
+		}
+		if (!class_escape(&ps->rs->charsets[set], c))
+			set_add(&ps->rs->charsets[set], c);
+	} else {
+		set_add(&ps->rs->charsets[set], c);
+	}
+	ast = ast_new(ast_set, NULL, NULL);
+	ast->set = set;
+	return ast;
+}
+
+/* parse_bound -- parse {m}, {m,}, or {m,n}; ps->p is just past the {.
+ */
+static struct ast *
+parse_bound(struct parse *ps, struct ast *atom) {
+	struct ast *ast = NULL;
+	long lo, hi;
+	char *ep;
+	int i;
+
+	lo = strtol(ps->p, &ep, 10);
+	if (ep == ps->p || lo < 0 || lo > MAX_REPEAT)
+		goto bad;
+	hi = lo;
+	ps->p = ep;
+	if (*ps->p == ',') {
+		ps->p++;
+		if (*ps->p == '}') {
+			hi = -1;
+		} else {
+			hi = strtol(ps->p, &ep, 10);
+			if (ep == ps->p || hi < lo || hi > MAX_REPEAT)
+				goto bad;
+			ps->p = ep;
+		}
+	}
+	if (*ps->p++ != '}')
+		goto bad;
+
+	/* x{2,4} is xx(x(x)?)? and x{2,} is xxx*; subtrees are shared,
+	 * which is fine since compile() only reads them.
+	 */
+	if (hi == -1) {
+		ast = ast_new(ast_star, atom, NULL);
+	} else {
+		for (i = (int)lo; i < hi; i++)
+			ast = ast_new(ast_quest, ast == NULL ? atom
+				      : ast_new(ast_cat, atom, ast), NULL);
+	}
+	for (i = 0; i < lo; i++)
+		ast = (ast == NULL) ? atom : ast_new(ast_cat, atom, ast);
+	if (ast == NULL) {
+		/* x{0} matches only the empty string. */
+		ast_free(atom);
+		ast = ast_new(ast_empty, NULL, NULL);
+	}
+	return ast;
+ bad:
+	ps->err = "bad {m,n} repetition";
+	return atom;
+}
+
+/* parse_repeat -- parse an atom and any repetition operators after it.
+ */
+static struct ast *
+parse_repeat(struct parse *ps) {
+	struct ast *ast = parse_atom(ps);
+
+	while (ps->err == NULL) {
+		switch (*ps->p) {
+		case '*':
+			ast = ast_new(ast_star, ast, NULL);
+			break;
+		case '+':
+			ast = ast_new(ast_plus, ast, NULL);
+			break;
+		case '?':
+			ast = ast_new(ast_quest, ast, NULL);
+			break;
+		case '{':
+			ps->p++;
+			ast = parse_bound(ps, ast);
+			continue;
+		default:
+			return ast;
+		}
+		ps->p++;
+	}
+	return ast;
+}
+
+/* parse_cat -- parse a concatenation, up to | or ) or the end.
+ */
+static struct ast *
+parse_cat(struct parse *ps) {
+	struct ast *ast = NULL;
+
+	while (ps->err == NULL && *ps->p != '\0' &&
+	       *ps->p != '|' && *ps->p != ')')
+	{
+		struct ast *next = parse_repeat(ps);
+
+		ast = (ast == NULL) ? next : ast_new(ast_cat, ast, next);
+	}
+	if (ast == NULL)
+		ast = ast_new(ast_empty, NULL, NULL);
+	return ast;
+}
+
+/* parse_alt -- parse an alternation.
+ */
+static struct ast *
+parse_alt(struct parse *ps) {
+	struct ast *ast = parse_cat(ps);
+
+	while (ps->err == NULL && *ps->p == '|') {
+		ps->p++;
+		ast = ast_new(ast_alt, ast, parse_cat(ps));
+	}
+	return ast;
+}
+
+static struct ast *
+ast_new(ast_e kind, struct ast *left, struct ast *right) {
+	struct ast *ast = NULL;
+
+	CREATE(ast, sizeof *ast);
+	ast->kind = kind;
+	ast->left = left;
+	ast->right = right;
+	return ast;
+}
+
+/* ast_free -- free a tree whose subtrees may be shared (see parse_bound).
+ */
+static void
+ast_free(struct ast *ast) {
+	struct ast **vec;
+	size_t n = 0, max = 16, i, j;
+
+	if (ast == NULL)
+		return;
+
+	/* collect distinct nodes, then free each once. */
+	vec = malloc(max * sizeof *vec);
+	if (vec == NULL)
+		my_panic(true, "malloc");
+	vec[n++] = ast;
+	for (i = 0; i < n; i++) {
+		struct ast *kids[2] = { vec[i]->left, vec[i]->right };
+		int k;
+
+		for (k = 0; k < 2; k++) {
+			if (kids[k] == NULL)
+				continue;
+			for (j = 0; j < n && vec[j] != kids[k]; j++)
+				;
+			if (j < n)
+				continue;
+			if (n == max) {
+				vec = realloc(vec, (max *= 2) * sizeof *vec);
+				if (vec == NULL)
+					my_panic(true, "realloc");
+			}
+			vec[n++] = kids[k];
+		}
+	}
+	for (i = 0; i < n; i++)
+		free(vec[i]);
+	free(vec);
+}
+
+/*---------------------------------------------------------------- NFA
+ */
+
+static int
+charset_new(regset_t rs) {
+	if (rs->ncharsets == rs->maxcharsets) {
+		rs->maxcharsets = rs->maxcharsets ? rs->maxcharsets * 2 : 64;
+		rs->charsets = realloc(rs->charsets,
+				       rs->maxcharsets * sizeof *rs->charsets);
+		if (rs->charsets == NULL)
+			my_panic(true, "realloc");
+	}
+	memset(&rs->charsets[rs->ncharsets], 0, sizeof *rs->charsets);
+	return (int)rs->ncharsets++;
+}
+
+static int
+nstate_new(regset_t rs, nstate_e kind, int out, int out1) {
+	struct nstate *ns;
+
+	if (rs->nnstates == rs->maxnstates) {
+		rs->maxnstates = rs->maxnstates ? rs->maxnstates * 2 : 256;
+		rs->nstates = realloc(rs->nstates,
+				      rs->maxnstates * sizeof *rs->nstates);
+		if (rs->nstates == NULL)
+			my_panic(true, "realloc");
+	}
+	ns = &rs->nstates[rs->nnstates];
+	memset(ns, 0, sizeof *ns);
+	ns->kind = kind;
+	ns->out = out;
+	ns->out1 = out1;
+	return (int)rs->nnstates++;
+}
+
+/* compile -- emit NFA states for a tree, continuing to state next.
+ *
+ * returns the entry state.
+ */
+static int
+compile(regset_t rs, const struct ast *ast, int next) {
+	int s, body;
+
+	switch (ast->kind) {
+	case ast_set:
+		s = nstate_new(rs, ns_set, next, -1);
+		rs->nstates[s].set = ast->set;
+		return s;
+	case ast_eol:
+		return nstate_new(rs, ns_eol, next, -1);
+	case ast_cat:
+		return compile(rs, ast->left, compile(rs, ast->right, next));
+	case ast_alt:
+		s = compile(rs, ast->left, next);
+		return nstate_new(rs, ns_split, s,
+				  compile(rs, ast->right, next));
+	case ast_star:
+		s = nstate_new(rs, ns_split, -1, next);
+		body = compile(rs, ast->left, s);
+		rs->nstates[s].out = body;
+		return s;
+	case ast_plus:
+		s = nstate_new(rs, ns_split, -1, next);
+		body = compile(rs, ast->left, s);
+		rs->nstates[s].out = body;
+		return body;
+	case ast_quest:
+		s = compile(rs, ast->left, next);
+		return nstate_new(rs, ns_split, s, next);
+	case ast_empty:
+		return next;
+	}
+	abort();
+}
+
+/*---------------------------------------------------------------- DFA
+ */
+
+/* closure -- add the epsilon closure of one NFA state to a set.
+ *
+ * states already stamped with the current generation are skipped.
+ */
+static void
+closure(regset_t rs, int s, int *set, size_t *n) {
+	size_t top = 0;
+
+	rs->work[top++] = s;
+	while (top > 0) {
+		s = rs->work[--top];
+		if (s < 0 || rs->nstamp[s] == rs->gen)
+			continue;
+		rs->nstamp[s] = rs->gen;
+		if (rs->nstates[s].kind == ns_split) {
+			rs->work[top++] = rs->nstates[s].out1;
+			rs->work[top++] = rs->nstates[s].out;
+		} else {
+			set[(*n)++] = s;
+		}
+	}
+}
+
+static int
+int_cmp(const void *a, const void *b) {
+	int x = *(const int *)a, y = *(const int *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* next_gen -- start a new closure computation.
+ */
+static void
+next_gen(regset_t rs) {
+	if (++rs->gen == 0) {
+		memset(rs->nstamp, 0, rs->nnstates * sizeof(unsigned));
+		rs->gen = 1;
+	}
+}
+
+/* dstate_intern -- find or create the DFA state for a set of NFA states.
+ *
+ * the set is sorted in place; it is copied if a new state is made.
+ */
+static int
+dstate_intern(regset_t rs, int *set, size_t n) {
+	struct dstate *d;
+	hashent_t ent;
+	bool created;
+	size_t i;
+
+	qsort(set, n, sizeof *set, int_cmp);
+	ent = hash_put(rs->dindex, (const char *)set, n * sizeof *set,
+		       &created);
+	if (!created)
+		return (int)ent->val.num;
+
+	if (rs->ndstates == rs->maxdstates) {
+		rs->maxdstates = rs->maxdstates ? rs->maxdstates * 2 : 64;
+		rs->dstates = realloc(rs->dstates,
+				      rs->maxdstates * sizeof *rs->dstates);
+		if (rs->dstates == NULL)
+			my_panic(true, "realloc");
+	}
+	d = &rs->dstates[rs->ndstates];
+	memset(d, 0, sizeof *d);
+	memset(d->next, 0xff, sizeof d->next);
+	d->nfa = malloc((n ? n : 1) * sizeof *set);
+	if (d->nfa == NULL)
+		my_panic(true, "malloc");
+	memcpy(d->nfa, set, n * sizeof *set);
+	d->nnfa = n;
+	for (i = 0; i < n; i++)
+		if (rs->nstates[set[i]].kind == ns_match)
+			d->nmatches++;
+	if (d->nmatches != 0) {
+		d->matches = malloc(d->nmatches * sizeof *d->matches);
+		if (d->matches == NULL)
+			my_panic(true, "malloc");
+		d->nmatches = 0;
+		for (i = 0; i < n; i++)
+			if (rs->nstates[set[i]].kind == ns_match)
+				d->matches[d->nmatches++] =
+					rs->nstates[set[i]].pattern;
+	}
+	ent->val.num = (long)rs->ndstates;
+	return (int)rs->ndstates++;
+}
+
+/* dstate_step -- compute (and cache) one DFA transition.
+ */
+static int
+dstate_step(regset_t rs, int from, int sym) {
+	int *set = malloc((rs->nnstates + 1) * sizeof *set);
+	size_t n = 0, i;
+	int to;
+
+	if (set == NULL)
+		my_panic(true, "malloc");
+	if (rs->ndstates >= DFA_MAX_STATES) {
+		/* carry the source state's NFA set across the flush. */
+		int *old = rs->dstates[from].nfa;
+		size_t nold = rs->dstates[from].nnfa;
+
+		rs->dstates[from].nfa = NULL;
+		dfa_flush(rs);
+		from = dstate_intern(rs, old, nold);
+		DESTROY(old);
+	}
+
+	next_gen(rs);
+	for (i = 0; i < rs->dstates[from].nnfa; i++) {
+		const struct nstate *ns =
+			&rs->nstates[rs->dstates[from].nfa[i]];
+
+		if ((ns->kind == ns_set && sym != SYM_EOL &&
+		     set_has(&rs->charsets[ns->set], sym)) ||
+		    (ns->kind == ns_eol && sym == SYM_EOL))
+			closure(rs, ns->out, set, &n);
+	}
+	/* unanchored branches may start matching at any position. */
+	if (sym != SYM_EOL)
+		for (i = 0; i < rs->npatterns; i++)
+			if (rs->patterns[i].floating >= 0)
+				closure(rs, rs->patterns[i].floating,
+					set, &n);
+	to = dstate_intern(rs, set, n);
+	rs->dstates[from].next[sym] = to;
+	DESTROY(set);
+	return to;
+}
+
+/* dfa_flush -- discard the DFA and make a fresh start state.
+ */
+static void
+dfa_flush(regset_t rs) {
+	size_t i, n = 0;
+	int *set;
+
+	DEBUG(2, true, "regset: flushing %zu DFA states\n", rs->ndstates);
+	for (i = 0; i < rs->ndstates; i++) {
+		DESTROY(rs->dstates[i].nfa);
+		DESTROY(rs->dstates[i].matches);
+	}
+	rs->ndstates = 0;
+	hash_destroy(rs->dindex, NULL);
+	rs->dindex = hash_new();
+
+	/* (re)size the scratch areas for the current NFA. */
+	if (rs->dirty) {
+		rs->nstamp = realloc(rs->nstamp,
+				     rs->nnstates * sizeof *rs->nstamp);
+		rs->work = realloc(rs->work,
+				   2 * (rs->nnstates + 1) * sizeof *rs->work);
+		rs->found = realloc(rs->found,
+				    (rs->npatterns + 1) * sizeof *rs->found);
+		rs->pstamp = realloc(rs->pstamp,
+				     (rs->npatterns + 1) * sizeof *rs->pstamp);
+		if (rs->nstamp == NULL || rs->work == NULL ||
+		    rs->found == NULL || rs->pstamp == NULL)
+			my_panic(true, "realloc");
+		memset(rs->nstamp, 0, rs->nnstates * sizeof *rs->nstamp);
+		memset(rs->pstamp, 0, rs->npatterns * sizeof *rs->pstamp);
+		rs->gen = rs->pgen = 0;
+		rs->dirty = false;
+	}
+
+	set = malloc((rs->nnstates + 1) * sizeof *set);
+	if (set == NULL)
+		my_panic(true, "malloc");
+	next_gen(rs);
+	for (i = 0; i < rs->npatterns; i++)
+		closure(rs, rs->patterns[i].start, set, &n);
+	(void)dstate_intern(rs, set, n);
+	DESTROY(set);
+}
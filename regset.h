@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2014-2020 by Farsight Security, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef REGSET_H_INCLUDED
+#define REGSET_H_INCLUDED 1
+
+#include <stddef.h>
+
+/* a set of regular expressions matched together in one pass over the
+ * subject by a lazily built DFA.  the syntax is a POSIX ERE subset:
+ * literals, ., [...], [^...], \d \w \s (and uppercase negations),
+ * grouping, |, *, +, ?, {m,n}, $, and ^ leading the pattern or any of
+ * its top-level alternatives.  each alternative is searched for anywhere
+ * in the subject unless anchored with ^.
+ */
+typedef struct regset *regset_t;
+
+regset_t regset_new(void);
+const char *regset_add(regset_t, const char *, const char *);
+size_t regset_count(const struct regset *);
+const char *regset_id(const struct regset *, size_t);
+size_t regset_match(regset_t, const char *, size_t, const size_t **);
+void regset_destroy(regset_t);
+
+#endif /*REGSET_H_INCLUDED*/
@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2014-2020 by Farsight Security, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sys/types.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "defs.h"
+#include "pdns.h"
+#include "budget.h"
+#include "sample.h"
+#include "sink.h"
+#include "globals.h"
+
+/* one reservoir slot: the JSON text of a sampled result.  the buffer is
+ * kept when the slot is overwritten, so a full reservoir stops allocating.
+ */
+struct slot {
+	char		*buf;
+	size_t		 len, size;
+	unsigned long	 seq;
+};
+
+static double uniform(void);
+static void next_skip(void);
+static void slot_fill(struct slot *, pdns_tuple_ct, const char *, size_t);
+static int slot_cmp(const void *, const void *);
+
+static struct slot *slots = NULL;
+static size_t nslots = 0, maxslots = 0;
+static unsigned long seen = 0, next_pick = 0;
+static double sample_w = 0.0;
+
+/* sample_init -- start keeping a uniform sample of sample_size results,
+ * which are only passed on to the sinks at the end.
+ */
+void
+sample_init(void) {
+	maxslots = sample_size;
+	budget_need(maxslots * sizeof *slots, "--sample");
+	slots = calloc(maxslots, sizeof *slots);
+	if (slots == NULL)
+		my_panic(true, "calloc");
+	srandom((unsigned)(startup_time.tv_usec ^ startup_time.tv_sec ^
+			   getpid()));
+}
+
+/* present_sample -- consider one tuple for the reservoir; emit nothing.
+ *
+ * this is Li's "Algorithm L": once the reservoir is full, rather than
+ * drawing a random number per result it draws how many results to skip
+ * before the next one that replaces a random slot.
+ */
+void
+present_sample(pdns_tuple_ct tup, const char *jsonbuf, size_t jsonlen) {
+	seen++;
+	if (nslots < maxslots) {
+		slot_fill(&slots[nslots++], tup, jsonbuf, jsonlen);
+		if (nslots == maxslots) {
+			sample_w = 1.0;
+			next_skip();
+		}
+		return;
+	}
+	if (seen != next_pick)
+		return;
+	slot_fill(&slots[(size_t)random() % maxslots], tup, jsonbuf, jsonlen);
+	next_skip();
+}
+
+/* sample_fini -- hand the sample, in arrival order, to the sinks.
+ */
+void
+sample_fini(void) {
+	size_t i;
+
+	qsort(slots, nslots, sizeof *slots, slot_cmp);
+	for (i = 0; i < nslots; i++) {
+		struct pdns_tuple tup;
+		const char *msg;
+
+		msg = tuple_make_saved(&tup, slots[i].buf, slots[i].len);
+		if (msg != NULL) {
+			fputs(msg, stderr);
+			fputc('\n', stderr);
+			continue;
+		}
+		tup.obj.matched = json_object_get(tup.obj.saf_obj, "matched");
+		sinks_present(&tup, slots[i].buf, slots[i].len);
+		tuple_unmake(&tup);
+	}
+	if (!quiet)
+		my_logf("--sample: kept %zu of %lu result(s)", nslots, seen);
+
+	for (i = 0; i < maxslots; i++) {
+		budget_give(slots[i].size);
+		DESTROY(slots[i].buf);
+	}
+	budget_give(maxslots * sizeof *slots);
+	DESTROY(slots);
+	nslots = maxslots = 0;
+}
+
+/* uniform -- a random number in (0, 1).
+ */
+static double
+uniform(void) {
+	long r = random();
+
+	return ((double)r + 1.0) / ((double)RAND_MAX + 2.0);
+}
+
+/* next_skip -- shrink the acceptance weight and pick the next result that
+ * will enter the reservoir.
+ */
+static void
+next_skip(void) {
+	double skip;
+
+	sample_w *= exp(log(uniform()) / (double)maxslots);
+	skip = floor(log(uniform()) / log(1.0 - sample_w));
+	next_pick = seen + 1 + (unsigned long)skip;
+}
+
+/* slot_fill -- copy a result's JSON text into a reservoir slot.
+ *
+ * if --match-file added a "matched" array, the amended object is kept
+ * instead of the server's text.
+ */
+static void
+slot_fill(struct slot *slot, pdns_tuple_ct tup,
+	  const char *jsonbuf, size_t jsonlen)
+{
+	char *amended = NULL;
+
+	if (tup->obj.matched != NULL) {
+		amended = json_dumps(tup->obj.main, JSON_COMPACT);
+		jsonbuf = amended;
+		jsonlen = strlen(amended);
+	}
+	if (jsonlen > slot->size) {
+		budget_need(jsonlen - slot->size, "--sample");
+		slot->size = jsonlen;
+		slot->buf = realloc(slot->buf, slot->size);
+		if (slot->buf == NULL)
+			my_panic(true, "realloc");
+	}
+	memcpy(slot->buf, jsonbuf, jsonlen);
+	slot->len = jsonlen;
+	slot->seq = seen;
+	free(amended);
+}
+
+/* slot_cmp -- qsort comparator, by arrival order.
+ */
+static int
+slot_cmp(const void *a, const void *b) {
+	const struct slot *x = a, *y = b;
+
+	if (x->seq != y->seq)
+		return (x->seq < y->seq) ? -1 : 1;
+	return 0;
+}
@@ -0,0 +1,26 @@
+/*
+ * Copyright (c) 2014-2020 by Farsight Security, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SAMPLE_H_INCLUDED
+#define SAMPLE_H_INCLUDED 1
+
+#include "pdns.h"
+
+void sample_init(void);
+void present_sample(pdns_tuple_ct, const char *, size_t);
+void sample_fini(void);
+
+#endif /*SAMPLE_H_INCLUDED*/
@@ -0,0 +1,380 @@
+/*
+ * Copyright (c) 2014-2020 by Farsight Security, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* asprintf() and getline() do not appear on linux without this */
+#define _GNU_SOURCE
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include "defs.h"
+#include "netio.h"
+#include "pdns.h"
+#include "aimd.h"
+#include "hash.h"
+#include "plan.h"
+#include "quota.h"
+#include "sched.h"
+#include "globals.h"
+
+/* with no -A, a query's window is taken to start at 2010-01-01. */
+#define SCHED_EPOCH 1262304000UL
+
+/* one distinct query of the batch. */
+struct job {
+	struct qdesc	 qd;
+	double		 cost;
+	size_t		 line;
+};
+
+static char *job_key(qdesc_ct);
+static double job_cost(qdesc_ct);
+static size_t literals(qdesc_ct);
+static int job_cmp(const void *, const void *);
+static void launch(void);
+static void defer(void);
+
+static struct job *jobs = NULL;
+static size_t njobs = 0, maxjobs = 0, next_job = 0;
+static int running = 0;
+static unsigned long ncoalesced = 0;
+static hash_t seen = NULL;
+
+/* sched_load -- read a --batch file of query descriptors, one per line as
+ * --plan prints them ("-" for stdin), coalescing repeated queries.
+ *
+ * returns NULL on success, else an error message and the line it is for.
+ */
+const char *
+sched_load(const char *path, size_t *lineno) {
+	FILE *f = (strcmp(path, "-") == 0) ? stdin : fopen(path, "r");
+	const char *msg = NULL;
+	char *line = NULL;
+	size_t size = 0;
+	ssize_t len;
+
+	*lineno = 0;
+	if (f == NULL)
+		return strerror(errno);
+	if (seen == NULL)
+		seen = hash_new();
+	while ((len = getline(&line, &size, f)) >= 0) {
+		struct qdesc qd = {
+			method_none, search_rrnames, return_details,
+			.value = NULL, .exclude = NULL, .rrtype = NULL,
+			.after = 0, .before = 0, .complete = false,
+			.query_limit = -1, .output_limit = -1, .offset = 0 };
+		bool created;
+		char *key;
+
+		(*lineno)++;
+		while (len > 0 && isspace((unsigned char)line[len - 1]))
+			line[--len] = '\0';
+		if (len == 0 || line[0] == '#')
+			continue;
+		if (line[0] != '{') {
+			msg = "not a query descriptor";
+			break;
+		}
+		if ((msg = plan_load(line, &qd)) != NULL) {
+			DESTROY(qd.value);
+			DESTROY(qd.exclude);
+			DESTROY(qd.rrtype);
+			break;
+		}
+		if (qd.output_limit == -1 && qd.query_limit != -1)
+			qd.output_limit = qd.query_limit;
+
+		/* the same query on another line is run only once. */
+		key = job_key(&qd);
+		(void) hash_put(seen, key, strlen(key), &created);
+		DESTROY(key);
+		if (!created) {
+			ncoalesced++;
+			DESTROY(qd.value);
+			DESTROY(qd.exclude);
+			DESTROY(qd.rrtype);
+			continue;
+		}
+		if (njobs == maxjobs) {
+			maxjobs = (maxjobs == 0) ? 64 : maxjobs * 2;
+			jobs = realloc(jobs, maxjobs * sizeof *jobs);
+			if (jobs == NULL)
+				my_panic(true, "realloc");
+		}
+		jobs[njobs++] = (struct job){
+			.qd = qd, .cost = job_cost(&qd),
+			.line = *lineno
+		};
+	}
+	if (msg == NULL && ferror(f))
+		msg = strerror(errno);
+	if (msg == NULL && njobs == 0)
+		msg = "no queries";
+	DESTROY(line);
+	if (f != stdin)
+		fclose(f);
+	return msg;
+}
+
+/* sched_count -- the number of distinct queries loaded.
+ */
+size_t
+sched_count(void) {
+	return njobs;
+}
+
+/* sched_query -- one loaded query, for checking and escaping before it
+ * is run.
+ */
+qdesc_t
+sched_query(size_t i) {
+	return &jobs[i].qd;
+}
+
+/* sched_start -- run the loaded queries, cheapest first, as many at a
+ * time as aimd_jobs() allows.
+ *
+ * with a limited number of slots, running the short queries first gets
+ * each of them its results sooner, and lowers the mean completion time,
+ * without delaying the batch as a whole.
+ */
+void
+sched_start(void) {
+	qsort(jobs, njobs, sizeof *jobs, job_cmp);
+	next_job = 0;
+	launch();
+}
+
+/* sched_active -- true while any query is being or is to be run.
+ */
+bool
+sched_active(void) {
+	return running > 0 || (next_job < njobs && deadline_left() > 0 &&
+			       quota_left() > 0L);
+}
+
+/* sched_done -- a query has ended; start the next.
+ *
+ * the fetch has been reaped, so the query and its writer can go.
+ */
+void
+sched_done(query_t query) {
+	running--;
+	/* a limited answer is as good as it would be for a single query. */
+	switch (query->saf_cond) {
+	case sc_succeeded:
+	case sc_limited:
+	case sc_we_limited:
+		break;
+	case sc_init:
+	case sc_begin:
+	case sc_ongoing:
+	case sc_failed:
+	case sc_missing:
+		if (query_cut(query))
+			break;
+		my_logf("--batch: query %s failed: %s", query->command,
+			or_else(query->saf_msg,
+				or_else(query->message, "no result")));
+		exit_code = 1;
+		break;
+	}
+	writer_fini(query->writer);
+	launch();
+}
+
+/* sched_fini -- report and release.
+ */
+void
+sched_fini(void) {
+	size_t i;
+
+	if (!quiet)
+		my_logf("--batch: %zu query(ies) run, %lu repeated"
+			" query(ies) coalesced", next_job, ncoalesced);
+	if (next_job < njobs && quota_left() <= 0L) {
+		if (quota_defer != NULL) {
+			defer();
+		} else {
+			exit_code = 1;
+			if (!quiet)
+				my_logf("--batch: %zu query(ies) not run for"
+					" want of quota", njobs - next_job);
+		}
+	} else if (next_job < njobs) {
+		deadline_hit = true;
+		if (!quiet)
+			my_logf("--batch: %zu query(ies) not run before"
+				" --deadline", njobs - next_job);
+	}
+	for (i = 0; i < njobs; i++) {
+		DESTROY(jobs[i].qd.value);
+		DESTROY(jobs[i].qd.exclude);
+		DESTROY(jobs[i].qd.rrtype);
+	}
+	DESTROY(jobs);
+	njobs = maxjobs = next_job = 0;
+	hash_destroy(seen, NULL);
+	seen = NULL;
+}
+
+/* job_key -- the text by which repeats of a query are found.
+ *
+ * rrtypes are compared case-blind, as the server does.
+ */
+static char *
+job_key(qdesc_ct qdp) {
+	char *key = NULL, *rrtype, *p;
+	int x;
+
+	rrtype = strdup(or_else(qdp->rrtype, "ANY"));
+	for (p = rrtype; *p != '\0'; p++)
+		*p = (char)toupper((unsigned char)*p);
+	x = asprintf(&key, "%d\t%d\t%d\t%s\t%s\t%s\t"
+		     "%lu\t%lu\t%d\t%ld\t%ld\t%ld",
+		     qdp->search_method, qdp->what_to_search,
+		     qdp->mode_to_return, qdp->value,
+		     or_else(qdp->exclude, ""), rrtype,
+		     qdp->after, qdp->before, qdp->complete,
+		     qdp->query_limit, qdp->output_limit, qdp->offset);
+	if (x < 0)
+		my_panic(true, "asprintf");
+	DESTROY(rrtype);
+	return key;
+}
+
+/* job_cost -- guess how long a query will take, relative to the others.
+ *
+ * a pattern with more literal characters matches fewer names, a single
+ * rrtype is a fraction of them, and a time fence a fraction of the
+ * database's span; an offset must still be read past.  the guess only
+ * orders the batch, so its scale does not matter.
+ */
+static double
+job_cost(qdesc_ct qdp) {
+	u_long now = (u_long)time(NULL), after, before;
+	size_t nlit = literals(qdp);
+	double cost;
+
+	cost = 1.0 / (1.0 + (double)nlit);
+	if (qdp->rrtype != NULL && strcasecmp(qdp->rrtype, "ANY") != 0)
+		cost /= 4.0;
+	after = (qdp->after != 0) ? qdp->after : SCHED_EPOCH;
+	before = (qdp->before != 0) ? qdp->before : now;
+	if (before > after && now > SCHED_EPOCH && after >= SCHED_EPOCH)
+		cost *= (double)(before - after) / (double)(now - SCHED_EPOCH);
+	if (qdp->query_limit > 0)
+		cost *= 1.0 + (double)qdp->offset / (double)qdp->query_limit;
+	return cost;
+}
+
+/* literals -- count the characters of a pattern that match only
+ * themselves.
+ */
+static size_t
+literals(qdesc_ct qdp) {
+	bool glob = (qdp->search_method == method_glob);
+	size_t n = 0;
+	const char *p;
+
+	for (p = qdp->value; *p != '\0'; p++) {
+		if (*p == '[') {
+			/* a bracket expression matches one of several. */
+			if (p[1] == '!' || p[1] == '^')
+				p++;
+			if (p[1] == ']')
+				p++;
+			while (p[1] != '\0' && p[1] != ']')
+				p++;
+			if (p[1] == ']')
+				p++;
+		} else if (*p == '\\' && p[1] != '\0') {
+			p++;
+			n++;
+		} else if (glob ? strchr("*?", *p) == NULL
+			   : strchr(".*+?|(){}^$", *p) == NULL) {
+			n++;
+		}
+	}
+	return n;
+}
+
+/* job_cmp -- order jobs cheapest first, then as they were given.
+ */
+static int
+job_cmp(const void *a, const void *b) {
+	const struct job *x = a, *y = b;
+
+	if (x->cost < y->cost)
+		return -1;
+	if (x->cost > y->cost)
+		return 1;
+	return (x->line < y->line) ? -1 : (x->line > y->line);
+}
+
+/* launch -- start queued queries, up to aimd_jobs() at once.
+ */
+static void
+launch(void) {
+	while (next_job < njobs && (size_t)running < aimd_jobs() &&
+	       deadline_left() > 0 && quota_left() > 0L)
+	{
+		qdesc_ct qdp = &jobs[next_job++].qd;
+
+		query_launcher(qdp, writer_init(qdp->output_limit));
+		running++;
+	}
+}
+
+/* defer -- write the queries the quota left unrun to the --quota defer
+ * file, cheapest first, for a later --batch run.
+ */
+static void
+defer(void) {
+	CURL *easy;
+	FILE *f;
+	size_t i;
+
+	if ((f = fopen(quota_defer, "w")) == NULL) {
+		exit_code = 1;
+		my_logf("--quota: %s: %s", quota_defer, strerror(errno));
+		return;
+	}
+	/* the descriptors were escaped for the URL; --batch wants them
+	 * as they were read.
+	 */
+	easy = curl_easy_init();
+	for (i = next_job; i < njobs; i++) {
+		unescape(easy, &jobs[i].qd.value);
+		unescape(easy, &jobs[i].qd.exclude);
+		unescape(easy, &jobs[i].qd.rrtype);
+		plan_print(f, &jobs[i].qd);
+	}
+	curl_easy_cleanup(easy);
+	if (fclose(f) != 0) {
+		exit_code = 1;
+		my_logf("--quota: %s: %s", quota_defer, strerror(errno));
+	} else if (!quiet) {
+		my_logf("--batch: %zu query(ies) deferred to %s for want"
+			" of quota", njobs - next_job, quota_defer);
+	}
+}
@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2014-2020 by Farsight Security, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SCHED_H_INCLUDED
+#define SCHED_H_INCLUDED 1
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "netio.h"
+
+const char *sched_load(const char *, size_t *);
+size_t sched_count(void);
+qdesc_t sched_query(size_t);
+void sched_start(void);
+bool sched_active(void);
+void sched_done(query_t);
+void sched_fini(void);
+
+#endif /*SCHED_H_INCLUDED*/
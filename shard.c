@@ -0,0 +1,396 @@
+/*
+ * Copyright (c) 2014-2020 by Farsight Security, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* asprintf() does not appear on linux without this */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fnmatch.h>
+#include <regex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "defs.h"
+#include "netio.h"
+#include "pdns.h"
+#include "shard.h"
+#include "globals.h"
+
+/* at most this many unexpected names are shown by shard_verify(). */
+#define SHARD_SHOW 10
+
+static const char *glob_split(const char *, size_t *);
+static const char *regex_split(const char *, size_t *);
+static const char *regex_top_alt(const char *);
+static size_t bracket_len(const char *);
+static char *class_str(size_t, size_t, char);
+static bool pattern_match(search_method_t, const char *, regex_t *,
+			  const char *);
+
+/* shard_plan -- divide a query into k queries whose results are disjoint
+ * and together are those of the original.
+ *
+ * the pattern's first wildcard (* in a glob, .* in a regex) is split on
+ * the character it starts with.  if the pattern is PRE*REST, where PRE
+ * matches a fixed number of characters, then
+ *
+ *	shard 0 is PREREST, for when the wildcard can match nothing, and
+ *	shard i is PRE[Ci]*REST excluding PREREST, for i in 1..k-1,
+ *
+ * where the classes Ci partition all characters.  a result of the
+ * original either matches shard 0, or matches no shard but the one
+ * whose class holds the character after PRE.  the exclusion needs the
+ * query's exclude, so --exclude cannot be used as well.
+ *
+ * returns NULL and the k descriptors on success, else an error message.
+ */
+const char *
+shard_plan(qdesc_ct qdp, long k, struct qdesc **shardsp) {
+	const char *value = qdp->value, *msg, *pre, *rest, *star;
+	struct qdesc *shards;
+	size_t prelen, restpos, nclass, i;
+	char *empty;
+
+	if (k < SHARD_MIN || k > SHARD_MAX)
+		return "--shard must be between 3 and 37";
+	if (qdp->exclude != NULL)
+		return "--shard uses the exclusion itself, so --exclude"
+			" cannot be given";
+	if (qdp->search_method == method_glob) {
+		msg = glob_split(value, &prelen);
+		pre = "";
+		star = "*";
+		restpos = prelen + 1;
+	} else {
+		msg = regex_split(value, &prelen);
+		/* a leading .* is the same as ^.* */
+		pre = (value[0] == '^') ? "" : "^";
+		star = ".*";
+		restpos = prelen + 2;
+	}
+	if (msg != NULL)
+		return msg;
+	rest = value + restpos;
+
+	if (asprintf(&empty, "%s%.*s%s", pre, (int)prelen, value, rest) < 0)
+		my_panic(true, "asprintf");
+	shards = calloc((size_t)k, sizeof *shards);
+	if (shards == NULL)
+		my_panic(true, "calloc");
+	shards[0] = *qdp;
+	shards[0].value = empty;
+	nclass = (size_t)k - 1;
+	for (i = 0; i < nclass; i++) {
+		size_t lo = sizeof SHARD_ALPHABET - 1;
+		char *class;
+
+		/* the last class is everything the others are not. */
+		if (i + 1 < nclass)
+			class = class_str(lo * i / nclass,
+					  lo * (i + 1) / nclass, '\0');
+		else
+			class = class_str(0, lo * i / nclass,
+					  (qdp->search_method == method_glob)
+					  ? '!' : '^');
+		shards[i + 1] = *qdp;
+		if (asprintf(&shards[i + 1].value, "%s%.*s%s%s%s",
+			     pre, (int)prelen, value, class, star, rest) < 0)
+			my_panic(true, "asprintf");
+		shards[i + 1].exclude = strdup(empty);
+		DESTROY(class);
+	}
+	*shardsp = shards;
+	return NULL;
+}
+
+/* shard_verify -- check a shard plan against saved results: each result
+ * the original pattern matches must match exactly one shard, and no
+ * other result may match any.
+ *
+ * the file is read as --input reads it.  a report goes to stdout, and
+ * the exit code is set if the plan is wrong for any result.
+ */
+void
+shard_verify(qdesc_ct qdp, const struct qdesc *shards, size_t n,
+	     const char *path)
+{
+	search_method_t method = qdp->search_method;
+	regex_t *res = NULL;
+	long *counts = NULL;
+	long results = 0, matched = 0, uncovered = 0, twice = 0, stray = 0;
+	char *line = NULL;
+	size_t size = 0, i;
+	ssize_t len;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (f == NULL) {
+		my_logf("Cannot read %s: %s", path, strerror(errno));
+		my_exit(1);
+	}
+	/* [0] is the original; then each shard's value and exclusion. */
+	res = calloc(2 * n + 1, sizeof *res);
+	counts = calloc(n, sizeof *counts);
+	if (res == NULL || counts == NULL)
+		my_panic(true, "calloc");
+	if (method == method_regex) {
+		for (i = 0; i <= 2 * n; i++) {
+			const char *pat = (i == 0) ? qdp->value :
+				(i % 2 == 1) ? shards[i / 2].value :
+				shards[i / 2 - 1].exclude;
+
+			if (pat != NULL &&
+			    regcomp(&res[i], pat, REG_EXTENDED|REG_NOSUB) != 0)
+			{
+				my_logf("--shard-verify: cannot compile '%s'",
+					pat);
+				my_exit(1);
+			}
+		}
+	}
+
+	while ((len = getline(&line, &size, f)) > 0) {
+		struct pdns_tuple tup;
+		const char *name;
+		bool orig;
+		size_t hits = 0;
+
+		if (tuple_make_saved(&tup, line, (size_t)len) != NULL)
+			continue;
+		name = (qdp->what_to_search == search_rdata) ?
+			tup.rdata : tup.rrname;
+		if (tup.obj.saf_obj == NULL || name == NULL) {
+			tuple_unmake(&tup);
+			continue;
+		}
+		results++;
+		orig = pattern_match(method, qdp->value, &res[0], name);
+		for (i = 0; i < n; i++)
+			if (pattern_match(method, shards[i].value,
+					  &res[2 * i + 1], name) &&
+			    (shards[i].exclude == NULL ||
+			     !pattern_match(method, shards[i].exclude,
+					    &res[2 * i + 2], name)))
+			{
+				counts[i]++;
+				hits++;
+			}
+		if (orig)
+			matched++;
+		if ((orig && hits != 1) || (!orig && hits != 0)) {
+			if (orig && hits == 0)
+				uncovered++;
+			else if (orig)
+				twice++;
+			else
+				stray++;
+			if (uncovered + twice + stray <= SHARD_SHOW)
+				my_logf("--shard-verify: %s %s the original"
+					" and matches %zu shard(s)", name,
+					orig ? "matches" : "does not match",
+					hits);
+		}
+		tuple_unmake(&tup);
+	}
+	DESTROY(line);
+	fclose(f);
+
+	for (i = 0; i < n; i++)
+		printf("shard %zu: %s%s%s: %ld\n", i, shards[i].value,
+		       (shards[i].exclude != NULL) ? " except " : "",
+		       or_else(shards[i].exclude, ""), counts[i]);
+	printf("%ld result(s), %ld matching %s; %ld in no shard,"
+	       " %ld in two or more, %ld in a shard but not the original\n",
+	       results, matched, qdp->value, uncovered, twice, stray);
+	if (uncovered + twice + stray != 0)
+		exit_code = 1;
+
+	if (method == method_regex)
+		for (i = 0; i <= 2 * n; i++)
+			if (i == 0 || i % 2 == 1 || shards[i / 2 - 1].exclude)
+				regfree(&res[i]);
+	DESTROY(res);
+	DESTROY(counts);
+}
+
+/* shard_free -- release what shard_plan() made.
+ */
+void
+shard_free(struct qdesc *shards, size_t n) {
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		DESTROY(shards[i].value);
+		DESTROY(shards[i].exclude);
+	}
+	DESTROY(shards);
+}
+
+/* glob_split -- find the first * of a glob.
+ *
+ * every element before it ([...] or one character) matches exactly one
+ * character.
+ */
+static const char *
+glob_split(const char *glob, size_t *prelen) {
+	const char *p = glob;
+
+	while (*p != '\0' && *p != '*') {
+		if (*p == '[') {
+			size_t blen = bracket_len(p);
+
+			if (blen == 0)
+				return "--shard: unterminated [ in the glob";
+			p += blen;
+		} else {
+			p++;
+		}
+	}
+	if (*p != '*')
+		return "--shard needs a * in the glob";
+	*prelen = (size_t)(p - glob);
+	return NULL;
+}
+
+/* regex_split -- find the .* in a regex of the form ^PRE.*REST or .*REST.
+ *
+ * PRE may only hold atoms matching exactly one character each: literal
+ * characters, \ escapes, . and [...].  REST may not hold a | outside of
+ * parentheses, which would make it an alternative to all that precedes.
+ */
+static const char *
+regex_split(const char *regex, size_t *prelen) {
+	const char *p = regex;
+
+	if (*p == '^')
+		p++;
+	else if (strncmp(p, ".*", 2) != 0)
+		return "--shard needs a regex starting with ^ or .*";
+	for (;;) {
+		size_t alen;
+
+		if (*p == '\0')
+			return "--shard needs a .* in the regex";
+		if (strncmp(p, ".*", 2) == 0)
+			break;
+		if (*p == '\\' && p[1] != '\0')
+			alen = 2;
+		else if (*p == '[')
+			alen = bracket_len(p);
+		else if (strchr("()|*+?{}^$", *p) != NULL)
+			alen = 0;
+		else
+			alen = 1;
+		if (alen == 0 || (p[alen] != '\0' &&
+				  strchr("*+?{", p[alen]) != NULL))
+			return "--shard needs each element of a regex before"
+				" its first .* to match one character";
+		p += alen;
+	}
+	if (regex_top_alt(p + 2) != NULL)
+		return "--shard cannot split a regex with a top level |";
+	*prelen = (size_t)(p - regex);
+	return NULL;
+}
+
+/* regex_top_alt -- find a | outside parentheses and brackets, or NULL.
+ */
+static const char *
+regex_top_alt(const char *p) {
+	int depth = 0;
+
+	while (*p != '\0') {
+		if (*p == '\\' && p[1] != '\0') {
+			p += 2;
+			continue;
+		}
+		if (*p == '[') {
+			size_t blen = bracket_len(p);
+
+			p += (blen != 0) ? blen : 1;
+			continue;
+		}
+		if (*p == '(')
+			depth++;
+		else if (*p == ')')
+			depth--;
+		else if (*p == '|' && depth == 0)
+			return p;
+		p++;
+	}
+	return NULL;
+}
+
+/* bracket_len -- the length of a [...] expression, or 0 if unterminated.
+ *
+ * a ] right after the [ or the [^ or [! is a member, not the end.
+ */
+static size_t
+bracket_len(const char *p) {
+	const char *q = p + 1;
+
+	if (*q == '^' || *q == '!')
+		q++;
+	if (*q == ']')
+		q++;
+	q = strchr(q, ']');
+	return (q == NULL) ? 0 : (size_t)(q + 1 - p);
+}
+
+/* class_str -- a bracket expression for SHARD_ALPHABET[lo..hi), or if
+ * a negation character (! for globs, as in POSIX, ^ for regexes) is given
+ * for every other character.
+ */
+static char *
+class_str(size_t lo, size_t hi, char negation) {
+	/* the alphabet is digits then letters, each contiguous. */
+	const size_t ndigits = 10;
+	char buf[sizeof "[^0-9a-z]"], *p = buf;
+	size_t part;
+
+	*p++ = '[';
+	if (negation != '\0')
+		*p++ = negation;
+	for (part = 0; part < 2; part++) {
+		size_t from = (part == 0) ? lo : (lo > ndigits ? lo : ndigits);
+		size_t to = (part == 0) ? (hi < ndigits ? hi : ndigits) : hi;
+
+		if (from >= to)
+			continue;
+		*p++ = SHARD_ALPHABET[from];
+		if (to - from > 1) {
+			if (to - from > 2)
+				*p++ = '-';
+			*p++ = SHARD_ALPHABET[to - 1];
+		}
+	}
+	*p++ = ']';
+	*p = '\0';
+	return strdup(buf);
+}
+
+/* pattern_match -- does a name match a search expression, as the server
+ * would?  globs match the whole name; regexes match anywhere in it.
+ */
+static bool
+pattern_match(search_method_t method, const char *pat, regex_t *re,
+	      const char *name)
+{
+	if (method == method_glob)
+		return fnmatch(pat, name, FNM_NOESCAPE) == 0;
+	return regexec(re, name, 0, NULL, 0) == 0;
+}
@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2014-2020 by Farsight Security, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SHARD_H_INCLUDED
+#define SHARD_H_INCLUDED 1
+
+#include <stddef.h>
+
+#include "netio.h"
+
+/* the characters --shard divides among its character classes; any other
+ * character falls in the last, negated, class.
+ */
+#define SHARD_ALPHABET "0123456789abcdefghijklmnopqrstuvwxyz"
+/* the pattern with its wildcard matching nothing, plus one shard per
+ * class, the last class holding at least one alphabet character.
+ */
+#define SHARD_MIN 3
+#define SHARD_MAX ((long)sizeof SHARD_ALPHABET)
+
+const char *shard_plan(qdesc_ct, long, struct qdesc **);
+void shard_verify(qdesc_ct, const struct qdesc *, size_t, const char *);
+void shard_free(struct qdesc *, size_t);
+
+#endif /*SHARD_H_INCLUDED*/
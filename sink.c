@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2014-2020 by Farsight Security, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "defs.h"
+#include "pdns.h"
+#include "aggregate.h"
+#include "arrow.h"
+#include "group.h"
+#include "plugin.h"
+#include "sketch.h"
+#include "sqlite.h"
+#include "sink.h"
+#include "globals.h"
+
+/* the FORMAT names accepted by --output. */
+static const struct format {
+	const char	*name;
+	present_e	 format;
+} formats[] = {
+	{ "json", pres_json },
+	{ "batch", pres_batch },
+	{ "batch-dedup", pres_batch_dedup_rrtype },
+	{ "collapse", pres_json_grouped },
+	{ "aggregate", pres_aggregate },
+	{ "sketch", pres_sketch },
+	{ "arrow", pres_arrow },
+};
+
+/* sink_format -- look up an --output FORMAT name.
+ *
+ * returns NULL if ok, else a static error message.
+ */
+const char *
+sink_format(const char *name, present_e *format) {
+	size_t i;
+
+	for (i = 0; i < sizeof formats / sizeof formats[0]; i++)
+		if (strcmp(formats[i].name, name) == 0) {
+			*format = formats[i].format;
+			return NULL;
+		}
+	return "--output FORMAT must be json, batch, batch-dedup, collapse,"
+		" aggregate, sketch, or arrow";
+}
+
+/* sink_add -- add an output in some format to a file, or to stdout if the
+ * path is NULL or "-".
+ *
+ * presenters that keep state between results keep it per format, so each
+ * such format may be used by only one sink; json and batch keep none.
+ * returns NULL if ok, else a static error message.
+ */
+const char *
+sink_add(present_e format, const char *path) {
+	bool stateless = format == pres_json || format == pres_batch;
+	sink_t sink = NULL, *tail;
+
+	for (tail = &sinks; *tail != NULL; tail = &(*tail)->next)
+		if (!stateless && (*tail)->format == format)
+			return "each output format other than json and batch"
+				" may be used only once";
+
+	CREATE(sink, sizeof *sink);
+	sink->format = format;
+	if (path == NULL || strcmp(path, "-") == 0) {
+		sink->out = stdout;
+	} else {
+		sink->path = strdup(path);
+		sink->out = fopen(path, "w");
+		if (sink->out == NULL)
+			my_panic(true, path);
+		setvbuf(sink->out, NULL, _IOFBF, SINK_BUFSIZ);
+	}
+
+	switch (format) {
+	case pres_json:
+		sink->present = present_json;
+		break;
+	case pres_batch:
+		sink->present = present_batch;
+		break;
+	case pres_batch_dedup_rrtype:
+		sink->present = present_batch_dedup_rrtype;
+		break;
+	case pres_aggregate:
+		sink->present = present_aggregate;
+		sink->fini = aggregate_fini;
+		break;
+	case pres_json_grouped:
+		sink->present = present_json_grouped;
+		sink->fini = group_fini;
+		break;
+	case pres_sketch:
+		sink->present = present_sketch;
+		sink->fini = sketch_fini;
+		break;
+	case pres_arrow:
+		sink->present = present_arrow;
+		sink->fini = arrow_fini;
+		break;
+	case pres_plugin:
+		sink->present = present_plugin;
+		sink->fini = plugin_fini;
+		break;
+#ifdef WANT_SQLITE
+	case pres_sqlite:
+		sink->present = present_sqlite;
+		sink->fini = sqlite_fini;
+		break;
+#endif
+	default:
+		abort();
+	}
+	*tail = sink;
+	return NULL;
+}
+
+/* sinks_present -- hand one parsed result to every sink.
+ */
+void
+sinks_present(pdns_tuple_ct tup, const char *jsonbuf, size_t jsonlen) {
+	sink_t sink;
+
+	for (sink = sinks; sink != NULL; sink = sink->next)
+		(*sink->present)(tup, jsonbuf, jsonlen, sink);
+}
+
+/* sinks_fini -- let every sink finish its output, then close them all.
+ */
+void
+sinks_fini(void) {
+	while (sinks != NULL) {
+		sink_t sink = sinks;
+
+		sinks = sink->next;
+		if (sink->fini != NULL)
+			(*sink->fini)(sink);
+		if (sink->path != NULL) {
+			if (fclose(sink->out) != 0)
+				my_panic(true, sink->path);
+			DESTROY(sink->path);
+		} else {
+			fflush(sink->out);
+		}
+		DESTROY(sink);
+	}
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2014-2020 by Farsight Security, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SINK_H_INCLUDED
+#define SINK_H_INCLUDED 1
+
+#include <stdio.h>
+
+#include "pdns.h"
+
+/* stdio buffer size for each sink written to a file */
+#define SINK_BUFSIZ (64 * 1024)
+
+/* one output: a presenter and the stream it writes to.  every result is
+ * parsed once and then handed to each sink in turn.
+ */
+struct sink {
+	struct sink	*next;
+	present_e	 format;
+	present_t	 present;
+	present_fini_t	 fini;
+	FILE		*out;
+	char		*path;
+};
+
+const char *sink_format(const char *, present_e *);
+const char *sink_add(present_e, const char *);
+void sinks_present(pdns_tuple_ct, const char *, size_t);
+void sinks_fini(void);
+
+#endif /*SINK_H_INCLUDED*/
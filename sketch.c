@@ -0,0 +1,346 @@
+/*
+ * Copyright (c) 2014-2020 by Farsight Security, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "defs.h"
+#include "pdns.h"
+#include "aggregate.h"
+#include "budget.h"
+#include "sink.h"
+#include "sketch.h"
+#include "globals.h"
+
+#define HLL_REGISTERS (1U << SKETCH_HLL_BITS)
+#define CM_WIDTH (1U << SKETCH_CM_BITS)
+
+/* one HyperLogLog estimator of distinct names, for one rrtype. */
+struct hll {
+	char		*rrtype;
+	uint8_t		 reg[HLL_REGISTERS];
+};
+
+/* one of the heaviest zones seen so far, with its count-min estimate. */
+struct heavy {
+	char		*zone;
+	uint32_t	 count;
+};
+
+static uint64_t hash64(const char *, size_t);
+static struct hll *hll_find(const char *);
+static void hll_add(struct hll *, uint64_t);
+static double hll_estimate(const struct hll *);
+static uint32_t cm_add(uint64_t);
+static void heavy_offer(const char *, uint32_t);
+static void heavy_sift(size_t);
+static int heavy_cmp(const void *, const void *);
+
+static struct hll *hlls[SKETCH_MAX_RRTYPES + 1];
+static size_t nhlls = 0;
+static struct hll *hll_all = NULL;
+static uint32_t (*cm)[CM_WIDTH] = NULL;
+static struct heavy heavy[SKETCH_TOP_K];
+static size_t nheavy = 0;
+static unsigned long sketch_rows = 0;
+
+/* present_sketch -- fold one tuple into the sketches; emit nothing.
+ *
+ * each name (rrname, or rdata for rdata searches) is counted toward the
+ * distinct-name estimate of its rrtype and of all rrtypes together, and
+ * its parent zone toward the count-min sketch and the top-K list.
+ */
+void
+present_sketch(pdns_tuple_ct tup,
+	       const char *jsonbuf __attribute__ ((unused)),
+	       size_t jsonlen __attribute__ ((unused)),
+	       sink_t sink __attribute__ ((unused)))
+{
+	const char *name = or_else(tup->rrname, or_else(tup->rdata, ""));
+	const char *zone;
+	uint64_t h;
+
+	if (cm == NULL) {
+		budget_need(SKETCH_CM_DEPTH * sizeof *cm, "--sketch");
+		cm = calloc(SKETCH_CM_DEPTH, sizeof *cm);
+		if (cm == NULL)
+			my_panic(true, "calloc");
+		hll_all = hll_find("*");
+	}
+	sketch_rows++;
+
+	h = hash64(name, strlen(name));
+	hll_add(hll_all, h);
+	hll_add(hll_find(or_else(tup->rrtype, "")), h);
+
+	zone = name_suffix(name, AGGREGATE_ZONE_DEPTH);
+	heavy_offer(zone, cm_add(hash64(zone, strlen(zone))));
+}
+
+/* sketch_fini -- emit the estimates as JSON lines, then free the sketches.
+ *
+ * distinct-name estimates carry their relative standard error; zone counts
+ * never undercount, and overcount by at most "overcount" with the given
+ * confidence.
+ */
+void
+sketch_fini(sink_t sink) {
+	double stderr_rel = 1.04 / sqrt((double)HLL_REGISTERS);
+	double epsilon = exp(1.0) / (double)CM_WIDTH;
+	double confidence = 1.0 - exp(-(double)SKETCH_CM_DEPTH);
+	json_int_t overcount;
+	json_t *obj;
+	size_t i;
+
+	if (cm == NULL)
+		return;
+	overcount = (json_int_t)(epsilon * (double)sketch_rows) + 1;
+
+	obj = json_object();
+	json_object_set_new(obj, "rows", json_integer((json_int_t)sketch_rows));
+	json_dumpf(obj, sink->out, JSON_INDENT(0) | JSON_COMPACT);
+	putc('\n', sink->out);
+	json_decref(obj);
+
+	for (i = 0; i < nhlls; i++) {
+		obj = json_object();
+		json_object_set_new(obj, "rrtype",
+				    json_string(hlls[i]->rrtype));
+		json_object_set_new(obj, "distinct",
+			json_integer((json_int_t)llround(
+				hll_estimate(hlls[i]))));
+		json_object_set_new(obj, "stderr", json_real(stderr_rel));
+		json_dumpf(obj, sink->out, JSON_INDENT(0) | JSON_COMPACT |
+			   JSON_REAL_PRECISION(3));
+		putc('\n', sink->out);
+		json_decref(obj);
+	}
+
+	qsort(heavy, nheavy, sizeof heavy[0], heavy_cmp);
+	for (i = 0; i < nheavy; i++) {
+		obj = json_object();
+		json_object_set_new(obj, "zone", json_string(heavy[i].zone));
+		json_object_set_new(obj, "count",
+				    json_integer(heavy[i].count));
+		json_object_set_new(obj, "overcount",
+				    json_integer(overcount));
+		json_object_set_new(obj, "confidence", json_real(confidence));
+		json_dumpf(obj, sink->out, JSON_INDENT(0) | JSON_COMPACT |
+			   JSON_REAL_PRECISION(3));
+		putc('\n', sink->out);
+		json_decref(obj);
+		DESTROY(heavy[i].zone);
+	}
+	nheavy = 0;
+
+	for (i = 0; i < nhlls; i++) {
+		DESTROY(hlls[i]->rrtype);
+		DESTROY(hlls[i]);
+	}
+	budget_give(nhlls * sizeof **hlls);
+	nhlls = 0;
+	hll_all = NULL;
+	if (cm != NULL)
+		budget_give(SKETCH_CM_DEPTH * sizeof *cm);
+	DESTROY(cm);
+	sketch_rows = 0;
+}
+
+/* hash64 -- FNV-1a widened to 64 bits, then mixed so that every output bit
+ * depends on every input bit, as the HyperLogLog register split needs.
+ */
+static uint64_t
+hash64(const char *key, size_t len) {
+	uint64_t h = 14695981039346656037ULL;
+
+	while (len-- > 0) {
+		h ^= (uint8_t)*key++;
+		h *= 1099511628211ULL;
+	}
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+/* hll_find -- return the estimator for an rrtype, creating it if needed.
+ *
+ * past SKETCH_MAX_RRTYPES, further rrtypes are lumped under "other".
+ */
+static struct hll *
+hll_find(const char *rrtype) {
+	struct hll *hll = NULL;
+	size_t i;
+
+	for (i = 0; i < nhlls; i++)
+		if (strcmp(hlls[i]->rrtype, rrtype) == 0)
+			return hlls[i];
+	/* once full, the one spare slot is for "other". */
+	if (nhlls >= SKETCH_MAX_RRTYPES) {
+		rrtype = "other";
+		for (i = 0; i < nhlls; i++)
+			if (strcmp(hlls[i]->rrtype, rrtype) == 0)
+				return hlls[i];
+	}
+	budget_need(sizeof *hll, "--sketch");
+	CREATE(hll, sizeof *hll);
+	hll->rrtype = strdup(rrtype);
+	hlls[nhlls++] = hll;
+	return hll;
+}
+
+/* hll_add -- count one hashed item into a HyperLogLog.
+ *
+ * the low bits choose the register; the register keeps the highest rank
+ * (position of the first one bit) seen among the remaining bits.
+ */
+static void
+hll_add(struct hll *hll, uint64_t h) {
+	uint32_t idx = (uint32_t)(h & (HLL_REGISTERS - 1));
+	uint64_t rest = h >> SKETCH_HLL_BITS;
+	uint8_t rank = 1;
+
+	while (rank <= 64 - SKETCH_HLL_BITS && (rest & 1) == 0) {
+		rank++;
+		rest >>= 1;
+	}
+	if (rank > hll->reg[idx])
+		hll->reg[idx] = rank;
+}
+
+/* hll_estimate -- the HyperLogLog cardinality estimate, switching to
+ * linear counting while many registers are still empty.
+ */
+static double
+hll_estimate(const struct hll *hll) {
+	double m = (double)HLL_REGISTERS;
+	double alpha = 0.7213 / (1.0 + 1.079 / m);
+	double sum = 0.0, est;
+	size_t i, zeros = 0;
+
+	for (i = 0; i < HLL_REGISTERS; i++) {
+		sum += ldexp(1.0, -(int)hll->reg[i]);
+		if (hll->reg[i] == 0)
+			zeros++;
+	}
+	est = alpha * m * m / sum;
+	if (est <= 2.5 * m && zeros != 0)
+		est = m * log(m / (double)zeros);
+	return est;
+}
+
+/* cm_add -- count one hashed item into the count-min sketch and return
+ * its new estimated count.
+ *
+ * uses conservative update: only the counters at the current minimum are
+ * raised, which never undercounts and overcounts less than raising all.
+ */
+static uint32_t
+cm_add(uint64_t h) {
+	uint32_t idx[SKETCH_CM_DEPTH], min = UINT32_MAX;
+	size_t d;
+
+	/* derive one index per row from the two halves of the hash. */
+	for (d = 0; d < SKETCH_CM_DEPTH; d++) {
+		uint32_t hd = (uint32_t)h + (uint32_t)d * (uint32_t)(h >> 32);
+
+		idx[d] = hd & (CM_WIDTH - 1);
+		if (cm[d][idx[d]] < min)
+			min = cm[d][idx[d]];
+	}
+	if (min == UINT32_MAX)
+		return min;
+	min++;
+	for (d = 0; d < SKETCH_CM_DEPTH; d++)
+		if (cm[d][idx[d]] < min)
+			cm[d][idx[d]] = min;
+	return min;
+}
+
+/* heavy_offer -- consider a zone for the top-K list, given its new count.
+ *
+ * the list is a min-heap on count, so the lightest member is at the root
+ * and is the one displaced by a heavier newcomer.
+ */
+static void
+heavy_offer(const char *zone, uint32_t count) {
+	size_t i;
+
+	for (i = 0; i < nheavy; i++)
+		if (strcmp(heavy[i].zone, zone) == 0) {
+			heavy[i].count = count;
+			heavy_sift(i);
+			return;
+		}
+	if (nheavy < SKETCH_TOP_K) {
+		heavy[nheavy].zone = strdup(zone);
+		heavy[nheavy].count = count;
+		/* sift up. */
+		for (i = nheavy++; i > 0; i = (i - 1) / 2) {
+			size_t parent = (i - 1) / 2;
+			struct heavy tmp;
+
+			if (heavy[parent].count <= heavy[i].count)
+				break;
+			tmp = heavy[parent];
+			heavy[parent] = heavy[i];
+			heavy[i] = tmp;
+		}
+		return;
+	}
+	if (count <= heavy[0].count)
+		return;
+	DESTROY(heavy[0].zone);
+	heavy[0].zone = strdup(zone);
+	heavy[0].count = count;
+	heavy_sift(0);
+}
+
+/* heavy_sift -- restore the heap below an entry whose count has grown.
+ */
+static void
+heavy_sift(size_t i) {
+	for (;;) {
+		size_t least = i, l = 2 * i + 1, r = 2 * i + 2;
+		struct heavy tmp;
+
+		if (l < nheavy && heavy[l].count < heavy[least].count)
+			least = l;
+		if (r < nheavy && heavy[r].count < heavy[least].count)
+			least = r;
+		if (least == i)
+			return;
+		tmp = heavy[least];
+		heavy[least] = heavy[i];
+		heavy[i] = tmp;
+		i = least;
+	}
+}
+
+/* heavy_cmp -- qsort comparator, highest count first, then by zone.
+ */
+static int
+heavy_cmp(const void *a, const void *b) {
+	const struct heavy *x = a, *y = b;
+
+	if (x->count != y->count)
+		return (x->count > y->count) ? -1 : 1;
+	return strcmp(x->zone, y->zone);
+}
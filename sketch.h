@@ -0,0 +1,35 @@
+/*
+ * Copyright (c) 2014-2020 by Farsight Security, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SKETCH_H_INCLUDED
+#define SKETCH_H_INCLUDED 1
+
+#include "pdns.h"
+
+/* HyperLogLog precision: 2^14 one-byte registers, 0.81% standard error */
+#define SKETCH_HLL_BITS 14
+/* distinct rrtypes given their own HyperLogLog; the rest share one */
+#define SKETCH_MAX_RRTYPES 64
+/* count-min geometry: 4 rows of 2^16 counters, 1MB in all */
+#define SKETCH_CM_DEPTH 4
+#define SKETCH_CM_BITS 16
+/* how many of the heaviest parent zones are reported */
+#define SKETCH_TOP_K 25
+
+void present_sketch(pdns_tuple_ct, const char *, size_t, sink_t);
+void sketch_fini(sink_t);
+
+#endif /*SKETCH_H_INCLUDED*/
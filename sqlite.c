@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2014-2020 by Farsight Security, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef WANT_SQLITE
+
+/* asprintf() does not appear on linux without this */
+#define _GNU_SOURCE
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sqlite3.h>
+
+#include "defs.h"
+#include "pdns.h"
+#include "sqlite.h"
+#include "globals.h"
+
+static void sqlite_exec(const char *);
+static __attribute__((noreturn)) void sqlite_fail(const char *);
+
+static sqlite3 *db = NULL;
+static sqlite3_stmt *insert = NULL;
+static long batch_rows = SQLITE_BATCH_ROWS, in_batch = 0;
+static unsigned long inserted = 0;
+
+/* sqlite_open -- open (creating if need be) the DB:TABLE named by --sqlite.
+ *
+ * the table is created if missing.  with upsert, a unique index on
+ * (rrname, rdata, rrtype) is created too and a repeated row widens the
+ * stored time range instead of adding a row.
+ * returns NULL if ok, else a static error message.
+ */
+const char *
+sqlite_open(const char *arg, long batch, bool upsert) {
+	const char *colon = strrchr(arg, ':'), *p;
+	char *path, *sql;
+	int x;
+
+	if (colon == NULL || colon == arg || colon[1] == '\0')
+		return "--sqlite needs DB:TABLE";
+	for (p = colon + 1; *p != '\0'; p++)
+		if (!(isalpha((unsigned char)*p) || *p == '_' ||
+		      (p > colon + 1 && isdigit((unsigned char)*p))))
+			return "--sqlite TABLE must be a plain SQL identifier";
+	path = strndup(arg, (size_t)(colon - arg));
+	if (path == NULL)
+		my_panic(true, "strndup");
+	batch_rows = batch;
+
+	if (sqlite3_open(path, &db) != SQLITE_OK)
+		sqlite_fail(path);
+	DESTROY(path);
+	/* WAL lets the batches commit without a full sync each. */
+	sqlite_exec("PRAGMA journal_mode=WAL");
+	sqlite_exec("PRAGMA synchronous=NORMAL");
+
+	x = asprintf(&sql,
+		     "CREATE TABLE IF NOT EXISTS %s ("
+		     "rrname TEXT, rrtype TEXT, rdata TEXT, raw_rdata TEXT,"
+		     " count INTEGER, time_first INTEGER, time_last INTEGER)",
+		     colon + 1);
+	if (x < 0)
+		my_panic(true, "asprintf");
+	sqlite_exec(sql);
+	DESTROY(sql);
+
+	if (upsert) {
+		x = asprintf(&sql,
+			     "CREATE UNIQUE INDEX IF NOT EXISTS %s_key"
+			     " ON %s (ifnull(rrname, ''), ifnull(rdata, ''),"
+			     " rrtype)",
+			     colon + 1, colon + 1);
+		if (x < 0)
+			my_panic(true, "asprintf");
+		sqlite_exec(sql);
+		DESTROY(sql);
+		x = asprintf(&sql,
+			     "INSERT INTO %s VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7)"
+			     " ON CONFLICT (ifnull(rrname, ''),"
+			     " ifnull(rdata, ''), rrtype) DO UPDATE SET"
+			     " count = ifnull(count, 0) +"
+			     " ifnull(excluded.count, 0),"
+			     " time_first = min(ifnull(time_first,"
+			     " excluded.time_first), ifnull(excluded.time_first,"
+			     " time_first)),"
+			     " time_last = max(ifnull(time_last,"
+			     " excluded.time_last), ifnull(excluded.time_last,"
+			     " time_last))",
+			     colon + 1);
+	} else {
+		x = asprintf(&sql,
+			     "INSERT INTO %s VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7)",
+			     colon + 1);
+	}
+	if (x < 0)
+		my_panic(true, "asprintf");
+	if (sqlite3_prepare_v2(db, sql, -1, &insert, NULL) != SQLITE_OK)
+		sqlite_fail("prepare");
+	DESTROY(sql);
+	return NULL;
+}
+
+/* present_sqlite -- insert one tuple, committing every batch_rows rows.
+ */
+void
+present_sqlite(pdns_tuple_ct tup,
+	       const char *jsonbuf __attribute__ ((unused)),
+	       size_t jsonlen __attribute__ ((unused)),
+	       sink_t sink __attribute__ ((unused)))
+{
+	if (in_batch == 0)
+		sqlite_exec("BEGIN");
+
+	sqlite3_bind_text(insert, 1, tup->rrname, -1, SQLITE_STATIC);
+	sqlite3_bind_text(insert, 2, tup->rrtype, -1, SQLITE_STATIC);
+	sqlite3_bind_text(insert, 3, tup->rdata, -1, SQLITE_STATIC);
+	sqlite3_bind_text(insert, 4, tup->raw_rdata, -1, SQLITE_STATIC);
+	if (tup->obj.count != NULL)
+		sqlite3_bind_int64(insert, 5, tup->count);
+	else
+		sqlite3_bind_null(insert, 5);
+	if (tup->obj.time_first != NULL)
+		sqlite3_bind_int64(insert, 6, (sqlite3_int64)tup->time_first);
+	else
+		sqlite3_bind_null(insert, 6);
+	if (tup->obj.time_last != NULL)
+		sqlite3_bind_int64(insert, 7, (sqlite3_int64)tup->time_last);
+	else
+		sqlite3_bind_null(insert, 7);
+	if (sqlite3_step(insert) != SQLITE_DONE)
+		sqlite_fail("insert");
+	sqlite3_reset(insert);
+	inserted++;
+
+	if (++in_batch == batch_rows) {
+		sqlite_exec("COMMIT");
+		in_batch = 0;
+	}
+}
+
+/* sqlite_fini -- commit the last batch and close the database.
+ */
+void
+sqlite_fini(sink_t sink __attribute__ ((unused))) {
+	if (in_batch != 0)
+		sqlite_exec("COMMIT");
+	in_batch = 0;
+	sqlite3_finalize(insert);
+	insert = NULL;
+	sqlite3_close(db);
+	db = NULL;
+	if (!quiet)
+		my_logf("--sqlite: %lu row(s) written", inserted);
+}
+
+/* sqlite_exec -- run one SQL statement that returns no rows, or die.
+ */
+static void
+sqlite_exec(const char *sql) {
+	if (sqlite3_exec(db, sql, NULL, NULL, NULL) != SQLITE_OK)
+		sqlite_fail(sql);
+}
+
+/* sqlite_fail -- report the last SQLite error and exit.
+ */
+static void
+sqlite_fail(const char *what) {
+	my_logf("sqlite: %s: %s", what, sqlite3_errmsg(db));
+	my_exit(1);
+}
+
+#endif /*WANT_SQLITE*/
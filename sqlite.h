@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2014-2020 by Farsight Security, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SQLITE_H_INCLUDED
+#define SQLITE_H_INCLUDED 1
+
+#ifdef WANT_SQLITE
+
+#include "pdns.h"
+
+/* default number of rows inserted per transaction */
+#define SQLITE_BATCH_ROWS 50000
+
+const char *sqlite_open(const char *, long, bool);
+void present_sqlite(pdns_tuple_ct, const char *, size_t, sink_t);
+void sqlite_fini(sink_t);
+
+#endif /*WANT_SQLITE*/
+
+#endif /*SQLITE_H_INCLUDED*/
@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2014-2020 by Farsight Security, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "defs.h"
+#include "pdns.h"
+#include "hash.h"
+#include "suffix.h"
+#include "globals.h"
+
+/* a DNS name has at most 127 labels; allow for sloppy input. */
+#define MAX_LABELS 256
+/* a label is at most 63 octets, or four times that when \DDD escaped. */
+#define MAX_LABEL_LEN 255
+
+struct label {
+	const char	*start;
+	size_t		 len;
+};
+
+static int split_labels(const char *, struct label *);
+static size_t edge_key(char *, size_t, const struct label *);
+
+/* suffix_new -- create an empty suffix set.
+ */
+suffix_t
+suffix_new(void) {
+	suffix_t sfx = NULL;
+
+	CREATE(sfx, sizeof *sfx);
+	sfx->edges = hash_new();
+	sfx->maxnodes = 64;
+	sfx->terminal = calloc(sfx->maxnodes, sizeof(bool));
+	if (sfx->terminal == NULL)
+		my_panic(true, "calloc");
+	sfx->nnodes = 1;
+	return sfx;
+}
+
+/* suffix_add -- add one name suffix, e.g. "example.com." or "example.com".
+ *
+ * returns false if the name cannot be split into labels.
+ */
+bool
+suffix_add(suffix_t sfx, const char *name) {
+	struct label labels[MAX_LABELS];
+	char key[sizeof(uint32_t) + MAX_LABEL_LEN];
+	size_t node = 0;
+	int n;
+
+	n = split_labels(name, labels);
+	if (n <= 0)
+		return false;
+	while (n-- > 0) {
+		size_t keylen;
+		bool created;
+		hashent_t ent;
+
+		keylen = edge_key(key, node, &labels[n]);
+		ent = hash_put(sfx->edges, key, keylen, &created);
+		if (created) {
+			if (sfx->nnodes == sfx->maxnodes) {
+				sfx->maxnodes *= 2;
+				sfx->terminal = realloc(sfx->terminal,
+					sfx->maxnodes * sizeof(bool));
+				if (sfx->terminal == NULL)
+					my_panic(true, "realloc");
+			}
+			sfx->terminal[sfx->nnodes] = false;
+			ent->val.num = (long)sfx->nnodes++;
+		}
+		node = (size_t)ent->val.num;
+	}
+	if (!sfx->terminal[node])
+		sfx->nsuffixes++;
+	sfx->terminal[node] = true;
+	return true;
+}
+
+/* suffix_match -- true if the name equals or is beneath any suffix in the set.
+ *
+ * cost is one edge lookup per label of the name, however many suffixes
+ * there are.
+ */
+bool
+suffix_match(const struct suffix *sfx, const char *name) {
+	struct label labels[MAX_LABELS];
+	char key[sizeof(uint32_t) + MAX_LABEL_LEN];
+	size_t node = 0;
+	int n;
+
+	n = split_labels(name, labels);
+	while (n-- > 0) {
+		hashent_t ent;
+
+		ent = hash_get(sfx->edges, key,
+			       edge_key(key, node, &labels[n]));
+		if (ent == NULL)
+			return false;
+		node = (size_t)ent->val.num;
+		if (sfx->terminal[node])
+			return true;
+	}
+	return false;
+}
+
+/* suffix_destroy -- release a suffix set.
+ */
+void
+suffix_destroy(suffix_t sfx) {
+	if (sfx == NULL)
+		return;
+	hash_destroy(sfx->edges, NULL);
+	DESTROY(sfx->terminal);
+	DESTROY(sfx);
+}
+
+/* split_labels -- find the labels of a presentation-format name.
+ *
+ * returns the number of labels, or -1 if there are too many or one is too
+ * long.  the root label (a trailing dot) is not counted.
+ */
+static int
+split_labels(const char *name, struct label *labels) {
+	const char *p = name;
+	int n = 0;
+
+	while (*p != '\0') {
+		const char *start = p;
+
+		while (*p != '\0' && *p != '.') {
+			if (*p == '\\' && p[1] != '\0')
+				p++;
+			p++;
+		}
+		if (p > start) {
+			if (n == MAX_LABELS ||
+			    (size_t)(p - start) > MAX_LABEL_LEN)
+				return -1;
+			labels[n].start = start;
+			labels[n].len = (size_t)(p - start);
+			n++;
+		}
+		if (*p == '.')
+			p++;
+	}
+	return n;
+}
+
+/* edge_key -- form the edges table key for one label under one node.
+ *
+ * labels are compared case-insensitively, as in the DNS.
+ */
+static size_t
+edge_key(char *key, size_t node, const struct label *label) {
+	uint32_t parent = (uint32_t)node;
+	size_t i;
+
+	memcpy(key, &parent, sizeof parent);
+	for (i = 0; i < label->len; i++)
+		key[sizeof parent + i] =
+			(char)tolower((unsigned char)label->start[i]);
+	return sizeof parent + label->len;
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2014-2020 by Farsight Security, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SUFFIX_H_INCLUDED
+#define SUFFIX_H_INCLUDED 1
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "hash.h"
+
+/* a set of DNS name suffixes, kept as a trie of labels read right to left.
+ * node 0 is the root; every other node is reached from its parent by
+ * looking up (parent node number, label) in the edges table.
+ */
+struct suffix {
+	hash_t		 edges;
+	bool		*terminal;
+	size_t		 nnodes, maxnodes;
+	size_t		 nsuffixes;
+};
+typedef struct suffix *suffix_t;
+
+suffix_t suffix_new(void);
+bool suffix_add(suffix_t, const char *);
+bool suffix_match(const struct suffix *, const char *);
+void suffix_destroy(suffix_t);
+
+#endif /*SUFFIX_H_INCLUDED*/